@@ -0,0 +1,64 @@
+#!/bin/sh
+# Compila o simulador e executa cada roteiro deste diretório com -E,
+# conferindo o código de saída: 0 para os roteiros comuns e diferente de
+# 0 para os erro_*.txt, que devem ser rejeitados. Os roteiros são
+# executados em um diretório temporário, onde fica a topologia binária
+# gerada a partir de topologia.enlaces. Em seguida, o harness diferencial
+# (-d) compara o motor paralelo com o de referência em topologias geradas.
+#
+# Uso: roteiros/executa.sh [opções extras do simulador, como -u 47000]
+
+DIR=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+CC=${CC:-gcc}
+VD="$TMP/vetor_distancia"
+
+if ! $CC -Wall -O2 -pthread -o "$VD" "$DIR/../vetor_distancia.c" -lm; then
+	echo "Falha na compilação."
+	exit 1
+fi
+
+if ! "$VD" -c "$DIR/topologia.enlaces" "$TMP/topologia.bin" > /dev/null; then
+	echo "Falha na conversão da topologia."
+	exit 1
+fi
+
+falhas=0
+total=0
+
+for roteiro in "$DIR"/*.txt; do
+	
+	nome=$(basename "$roteiro")
+	total=$((total + 1))
+	
+	(cd "$TMP" && timeout 120 "$VD" -E "$roteiro" "$@") > "$TMP/saida" 2>&1
+	codigo=$?
+	
+	case "$nome" in
+		erro_*) [ $codigo -ne 0 ] && [ $codigo -ne 124 ]; ok=$? ;;
+		*)      [ $codigo -eq 0 ]; ok=$? ;;
+	esac
+	
+	if [ $ok -eq 0 ]; then
+		echo "ok      $nome"
+	else
+		echo "FALHOU  $nome (saída $codigo)"
+		grep -E "Afirmação|inválid|inexistente|divergem" "$TMP/saida" | sed 's/^/        /'
+		falhas=$((falhas + 1))
+	fi
+done
+
+echo "$((total - falhas)) de $total roteiros passaram."
+
+# Mais de uma thread, para que a fase de recebimento paralela seja exercitada.
+if "$VD" -T 4 -d 200 -r 1 > "$TMP/saida" 2>&1; then
+	echo "ok      diferencial ($(grep -o "[0-9]* de [0-9]* rodadas divergiram" "$TMP/saida"))"
+else
+	echo "FALHOU  diferencial"
+	grep -v "idênticos" "$TMP/saida" | sed 's/^/        /'
+	falhas=$((falhas + 1))
+fi
+
+[ $falhas -eq 0 ]
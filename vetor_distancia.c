@@ -4,10 +4,10 @@
  
  * Algumas notas:
  *
- * - A posição dos roteadores e seus enlaces é fixa (ver diagrama). As
- * conexões de enlaces são feitas à partir de uma matriz, o que, a
- * princípio, torna o programa configurável e escalavel. No entanto,
- * a alteração de valores não foi testada à fundo.
+ * - A topologia padrão é a do diagrama abaixo. As conexões de enlaces
+ * são feitas à partir de uma matriz, o que torna o programa configurável
+ * (ver a opção -t). O desenho na tela é calculado a partir da matriz,
+ * então acompanha topologias carregadas de arquivo.
  * 
  * - O usuário deve definir custos para as distâncias. Diferente do
  * protocolo RIP, a métrica é arbitrária e adimensional.
@@ -16,6 +16,8 @@
  * pacotes para cada roteador. Este valor diz respeito à quantos passos
  * de tempo do programa o roteador irá aguardar até enviar seus pacotes.
  * 
+ * - Compilação: gcc vetor_distancia.c -o vetor_distancia -pthread -lm
+ * 
  * 
  * Os roteadores estão conectados da forma abaixo. O programa simulará
  * estas conexões.
@@ -37,10 +39,31 @@
  */ 
 
 
+#define _GNU_SOURCE
+
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
 
 
 /* Redes distantes à INF pulos são consideradas inacessíveis.
@@ -65,6 +88,76 @@
 
 #define TEMPO_DE_PASSO 250000
 
+
+/* Distribuições possíveis para o intervalo (em passos) que um roteador
+ * aguarda entre dois envios de pacotes:
+ * - INTERVALO_FIXO: sempre INTERVALO_PERIODO, todos os roteadores em fase;
+ * - INTERVALO_UNIFORME: INTERVALO_PERIODO +- INTERVALO_JITTER por cento,
+ *   como o temporizador do RIP;
+ * - INTERVALO_EXPONENCIAL: sem memória, com média INTERVALO_PERIODO
+ *   (por ser discreta, é na verdade uma distribuição geométrica);
+ * - INTERVALO_PERIODICO: sempre INTERVALO_PERIODO, mas cada roteador
+ *   começa com uma fase sorteada.
+ * Com a distribuição uniforme, período 2 e jitter de 100%, o intervalo
+ * fica entre 0 e 4 passos. */
+enum{INTERVALO_FIXO = 0, INTERVALO_UNIFORME, INTERVALO_EXPONENCIAL, INTERVALO_PERIODICO};
+
+#define DISTRIBUICAO_INTERVALO INTERVALO_UNIFORME
+#define INTERVALO_PERIODO 2
+#define INTERVALO_JITTER 100
+
+/* Com jitter acima de 100% o intervalo sorteado poderia ser negativo. */
+#if INTERVALO_PERIODO < 1 || INTERVALO_JITTER < 0 || INTERVALO_JITTER > 100
+#error "INTERVALO_PERIODO precisa ser pelo menos 1 e INTERVALO_JITTER estar entre 0 e 100"
+#endif
+
+
+/* Atualizações disparadas: um roteador cuja tabela mudou envia seus
+ * pacotes sem esperar o intervalo, mas no máximo uma vez a cada espera
+ * sorteada entre DISPARO_ESPERA_MIN e DISPARO_ESPERA_MAX passos (como o
+ * temporizador de 1 a 5 segundos do RIP); as mudanças da espera seguem
+ * juntas na mesma atualização. Com o recuo exponencial, a espera dobra a
+ * cada disparo seguido, até 2^DISPARO_NIVEL_MAXIMO vezes, e volta ao
+ * normal quando uma espera termina sem mudanças. */
+#define DISPARO_ESPERA_MIN 1
+#define DISPARO_ESPERA_MAX 5
+#define DISPARO_NIVEL_MAXIMO 4
+
+
+/* Amortecimento de oscilações (RFC 2439): cada piora de uma rota aprendida
+ * soma AMORTECIMENTO_PENALIDADE à penalidade da rota, que decai pela
+ * metade a cada AMORTECIMENTO_MEIA_VIDA passos. Acima de
+ * AMORTECIMENTO_SUPRESSAO a rota é suprimida (os anúncios para ela são
+ * ignorados) até a penalidade cair abaixo de AMORTECIMENTO_REUSO. A
+ * penalidade nunca passa de AMORTECIMENTO_TETO, o que limita o tempo de
+ * supressão. */
+#define AMORTECIMENTO_PENALIDADE 1000
+#define AMORTECIMENTO_SUPRESSAO 2000
+#define AMORTECIMENTO_REUSO 750
+#define AMORTECIMENTO_MEIA_VIDA 15
+#define AMORTECIMENTO_TETO 6000
+
+
+/* Distância utilizada pelo oráculo para indicar que um destino não é
+ * alcançável. Diferente de INFINITO, não limita o tamanho das rotas e
+ * é grande o suficiente para não transbordar quando somada a um custo. */
+#define ORACULO_INF (INT_MAX/4)
+
+
+/* Quantidade máxima de threads utilizadas na fase de recebimento de
+ * pacotes. A quantidade usada é escolhida na execução (opção -T); com 1
+ * thread a simulação é inteiramente sequencial. */
+#define N_THREADS 8
+
+
+/* Parâmetros dos modos auxiliares (calibração, cenários e traço). */
+#define CALIBRACAO_PASSOS 20		// passos medidos por candidato na calibração
+#define CALIBRACAO_REPETICOES 3		// repetições por candidato (vale a mais rápida)
+#define RAMOS_SIMULTANEOS 4			// processos de cenário executados ao mesmo tempo
+#define INTERVALO_QUADROS 64		// passos entre quadros-chave do traço
+#define MAX_EVENTOS 4096			// eventos de um roteiro, depois de compilado
+#define MAX_JANELAS 64				// janelas de medição de um roteiro
+
 /* Enumeração para assignar IDs aos roteadores.
  * Em uma implementação real, isto não existiria.
  * Como o programa simula o comportamento dos roteadores em rede, é
@@ -113,6 +206,19 @@ int conexoes_enlaces [N_ROTEADORES][N_ROTEADORES] =
 };
 
 
+/* Custos dos enlaces, como inseridos pelo usuário. custos_enlaces[i][j]
+ * é o custo do enlace de i para j, ou ORACULO_INF se o enlace não existir.
+ * As tabelas dos roteadores são sobrescritas durante a simulação, por
+ * isso os custos originais precisam ser guardados à parte. */
+int custos_enlaces [N_ROTEADORES][N_ROTEADORES];
+
+
+/* Distâncias de referência calculadas pelo oráculo.
+ * distancias_referencia[i][j] é o menor custo de i até j. Cada coluna j
+ * é um problema de caminho mínimo independente (um por destino). */
+int distancias_referencia [N_ROTEADORES][N_ROTEADORES];
+
+
 typedef struct rota_t{		/* Rota */
 	
 	/* Estrutura que forma uma rota ideal até um ponto. Indica o destino,
@@ -145,10 +251,18 @@ typedef struct roteador{	/* Roteador */
 	* rotas: contém as rotas ideais para cada destino
 	* 
 	* idx: indexador da pilha de pacotes
-	* entrada: buffer de pacotes necessário pela natureza assíncrona da implementação. */
+	* entrada: buffer de pacotes necessário pela natureza assíncrona da implementação.
+	* 
+	* Atualizações disparadas (ver executa_roteador()):
+	* disparo_pendente: a tabela mudou desde o último envio
+	* espera_disparo: passos até que uma atualização disparada seja permitida
+	* nivel_disparo: expoente do recuo exponencial da espera */
 	
 	int id;
 	int intervalo;
+	int disparo_pendente;
+	int espera_disparo;
+	int nivel_disparo;
 	rota_t rotas [N_ROTEADORES];
 	
 	/* Por questões de simplicidade o buffer foi implementado como uma
@@ -160,11 +274,286 @@ typedef struct roteador{	/* Roteador */
 }roteador;
 
 
+typedef struct topologia_binaria_t{	/* Cabeçalho do arquivo de topologia */
+	
+	/* Arquivo binário de topologia, feito para ser mapeado na memória e
+	* usado sem nenhuma interpretação. Todos os campos são inteiros de 32
+	* bits little-endian e todas as seções começam em posições múltiplas
+	* de 8 bytes. As posições são contadas a partir do início do arquivo.
+	* 
+	* deslocamentos: n_roteadores+1 entradas; os vizinhos do roteador i
+	*                ficam entre deslocamentos[i] e deslocamentos[i+1] (CSR)
+	* vizinhos:      na versão 1, n_enlaces IDs de roteadores de 32 bits e
+	*                os deslocamentos contam enlaces. Na versão 2, a lista
+	*                de cada roteador é ordenada e guardada como diferenças
+	*                entre IDs consecutivos (o primeiro é absoluto), cada
+	*                uma em um varint (7 bits por byte, bit alto indica que
+	*                há mais bytes); os deslocamentos contam bytes
+	* custos:        n_enlaces custos, paralelos a vizinhos
+	* nomes:         n_roteadores+1 posições dentro da tabela de texto,
+	*                seguidas pelos nomes terminados em '\0' */
+	
+	char magica[4];
+	uint32_t versao;
+	uint32_t n_roteadores;
+	uint32_t n_enlaces;
+	uint32_t pos_deslocamentos;
+	uint32_t pos_vizinhos;
+	uint32_t pos_custos;
+	uint32_t pos_nomes;
+	uint32_t tamanho;
+	uint32_t reservado;
+}topologia_binaria_t;
+
+#define TOPOLOGIA_MAGICA "VDTB"
+#define TOPOLOGIA_VERSAO 2
+
+
+typedef struct convergido_t{	/* Cabeçalho do cache de estados convergidos */
+	
+	/* Arquivo "<chave>.vdc" no diretório do cache. As tabelas são gravadas
+	* como o próprio vetor de roteadores, a partir de pos_tabelas (múltiplo
+	* do tamanho de página), para que possam ser mapeadas direto na memória.
+	* Por isso o arquivo só vale para a mesma compilação: tamanho_roteador
+	* e n_roteadores precisam coincidir.
+	* 
+	* passo:          último passo simulado (a convergência ocorreu
+	*                 ESTADO_ESTATICO passos antes)
+	* pos_auxiliares: ultima_mudanca seguida de pacotes_enlace, usados
+	*                 pelo relatório de amostragem (-s) e pelo SVG (-g) */
+	
+	char magica[4];
+	uint32_t versao;
+	uint32_t n_roteadores;
+	uint32_t tamanho_roteador;
+	uint64_t chave;
+	uint32_t pos_auxiliares;
+	uint32_t pos_tabelas;
+	int32_t passo;
+	int64_t pacotes_enviados;
+	int64_t relaxacoes;
+}convergido_t;
+
+#define CONVERGIDO_MAGICA "VDCE"
+#define CONVERGIDO_VERSAO 2
+
+
+typedef struct traco_cabecalho_t{	/* Cabeçalho do arquivo de traço */
+	
+	/* Arquivo de traço de uma execução, feito para ser mapeado pelo
+	* depurador (-D). Os campos estão na ordem de bytes da máquina.
+	* 
+	* Depois do cabeçalho vêm registros de tamanho fixo (registro_traco_t)
+	* em ordem de passo. Um registro TRACO_QUADRO é seguido pelas tabelas
+	* inteiras (custo e caminho de cada rota, em int32_t); há um com o
+	* estado inicial (passo -1) e outro a cada intervalo_quadros passos.
+	* 
+	* indice:  n_quadros pares (passo, posição) de int64_t, um por quadro
+	* nomes:   os nomes dos roteadores terminados em '\0'
+	* 
+	* ultimo_passo, n_quadros, pos_indice e pos_nomes são preenchidos ao
+	* fechar o arquivo. */
+	
+	char magica[4];
+	uint32_t versao;
+	uint32_t n_roteadores;
+	uint32_t intervalo_quadros;
+	int32_t ultimo_passo;
+	uint32_t n_quadros;
+	uint64_t pos_indice;
+	uint64_t pos_nomes;
+}traco_cabecalho_t;
+
+typedef struct registro_traco_t{	/* Registro do traço */
+	
+	/* TRACO_ROTA:   a rota de "a" até "b" passou a ter custo "c" por "d"
+	* TRACO_ENLACE: o enlace de "a" para "b" passou a ter custo "c"
+	* TRACO_QUADRO: quadro-chave; as tabelas vêm em seguida */
+	
+	int32_t tipo;
+	int32_t passo;
+	int32_t a, b, c, d;
+}registro_traco_t;
+
+enum{TRACO_ROTA = 0, TRACO_ENLACE, TRACO_QUADRO};
+
+#define TRACO_MAGICA "VDTR"
+#define TRACO_VERSAO 1
+
+
+typedef struct evento_t{	/* Evento de um roteiro */
+	
+	/* Forma compilada de um roteiro (-E): um vetor ordenado por passo,
+	* consumido em ordem pelo laço principal sem nenhuma interpretação.
+	* Eventos de um passo são aplicados antes de ele ser executado.
+	* 
+	* EVENTO_ENLACE:        o enlace de "a" para "b" passa a ter "custo"
+	* EVENTO_JANELA_INICIO: começa a janela de medição "a"
+	* EVENTO_JANELA_FIM:    termina a janela de medição "a" */
+	
+	int passo;
+	int tipo;
+	int a, b;
+	int custo;
+}evento_t;
+
+enum{EVENTO_ENLACE = 0, EVENTO_JANELA_INICIO, EVENTO_JANELA_FIM};
+
+
+/* Configuração dos intervalos de envio. Começam com os valores definidos
+ * no início do arquivo. */
+int distribuicao_intervalo = DISTRIBUICAO_INTERVALO;
+int intervalo_periodo = INTERVALO_PERIODO;
+int intervalo_jitter = INTERVALO_JITTER;
+
+
+/* Destinos simulados. Normalmente são todos os roteadores, em ordem. No
+ * modo de amostragem apenas n_destinos colunas das tabelas são simuladas
+ * e os pacotes carregam somente estas rotas, nas primeiras posições. */
+int destinos_amostrados [N_ROTEADORES];
+int n_destinos = N_ROTEADORES;
+
+
+/* Último passo em que cada rota mudou: ultima_mudanca[roteador][destino],
+ * ou -1 se nunca mudou. Cada roteador só é alterado pela thread que o
+ * processa. */
+int ultima_mudanca [N_ROTEADORES][N_ROTEADORES];
+
+
+/* Quantidade de pacotes entregues aos buffers de entrada. */
+long pacotes_enviados = 0;
+
+
+/* Configuração das atualizações disparadas (desligadas por padrão) e seus
+ * contadores. O pico conta pacotes entregues e descartados em um passo. */
+int disparo_ativo = 0;
+int disparo_espera_min = DISPARO_ESPERA_MIN;
+int disparo_espera_max = DISPARO_ESPERA_MAX;
+int disparo_recuo = 0;
+long disparos_enviados = 0;
+long disparos_agrupados = 0;
+long pico_mensagens = 0;
+
+
+/* Estado do amortecimento de cada rota: penalidade[roteador][destino] vale
+ * no passo passo_penalidade (o decaimento é calculado só quando a rota é
+ * consultada). Enquanto a rota está suprimida, anuncio_suprimido guarda a
+ * rota que os anúncios ignorados teriam produzido, aplicada na liberação.
+ * Os contadores são por roteador, pois cada um é alterado apenas pela
+ * thread que o processa. */
+int amortecimento_ativo = 0;
+double penalidade [N_ROTEADORES][N_ROTEADORES];
+int passo_penalidade [N_ROTEADORES][N_ROTEADORES];
+char rota_suprimida [N_ROTEADORES][N_ROTEADORES];
+rota_t anuncio_suprimido [N_ROTEADORES][N_ROTEADORES];
+int suprimidas_roteador [N_ROTEADORES];
+long supressoes [N_ROTEADORES];
+long anuncios_ignorados [N_ROTEADORES];
+
+
+/* Quantidade de pacotes entregues em cada enlace: pacotes_enlace[src][dst]. */
+long pacotes_enlace [N_ROTEADORES][N_ROTEADORES];
+
+
+/* Soma da ocupação dos buffers de entrada ao fim da fase de envio e tempo
+ * acumulado da fase de envio, em segundos. */
+int ocupacao_entradas = 0;
+double tempo_envio = 0;
+
+
+typedef struct metricas_t{	/* Métricas */
+	
+	/* Retrato dos contadores da simulação publicado a cada passo para o
+	* servidor de métricas. */
+	
+	long passos;
+	long relaxacoes;
+	long pacotes_enviados;
+	long pacotes_descartados;
+	long ocupacao_entradas;
+	double tempo_envio;
+	double tempo_recebimento;
+}metricas_t;
+
+
+/* roteador_alterado indica quais roteadores tiveram a tabela alterada
+ * desde a última publicação do estado (por anúncios, por mudanças nos
+ * próprios enlaces ou pela liberação de rotas amortecidas) e é limpo por
+ * publica_estado(). alterado_no_recebimento vale só para o recebimento
+ * do passo atual e decide as atualizações disparadas. Durante o
+ * recebimento, cada posição é escrita apenas pela thread que processa o
+ * roteador. */
+char roteador_alterado [N_ROTEADORES];
+char alterado_no_recebimento [N_ROTEADORES];
+
+
+typedef struct estado_compartilhado_t{	/* Estado compartilhado */
+	
+	/* Região de memória compartilhada (POSIX) com o estado da simulação,
+	* para visualizadores externos. É protegida por um seqlock: o leitor
+	* guarda "sequencia", lê o que precisar direto da região e confere se
+	* a sequência continua igual e par; caso contrário, lê de novo.
+	* 
+	* alterados: um bit por roteador, ligado se a tabela mudou desde a
+	* publicação anterior, seja por anúncios, por uma mudança nos próprios
+	* enlaces ou por uma rota amortecida liberada. Apenas estes roteadores
+	* são copiados a cada passo. */
+	
+	char magica[4];
+	uint32_t versao;
+	uint32_t n_roteadores;
+	unsigned sequencia;
+	metricas_t metricas;
+	uint8_t alterados[(N_ROTEADORES + 7) / 8];
+	rota_t rotas[N_ROTEADORES][N_ROTEADORES];
+}estado_compartilhado_t;
+
+#define ESTADO_MAGICA "VDSM"
+#define ESTADO_VERSAO 1
+
+
+/* Indica se os pacotes são trocados por UDP (ver inicia_emulacao_udp()). */
+int emulacao_udp = 0;
+
+
+/* Quantidade de threads da fase de recebimento (até N_THREADS). */
+int n_threads = 1;
+
+
+/* Topologia e semente pedidas pelo roteiro (-E); a semente é -1 se ele não
+ * definir nenhuma. */
+char * roteiro_topologia = NULL;
+long roteiro_semente = -1;
+
+
+/* Passo atual da simulação, usado para marcar as mudanças de rotas. */
+int passo_atual = 0;
+
+
 /* Declaração de funções */
 
 // Front-end para a função que preenche os custos.
 void preencher_enlaces(roteador *);
 
+// Reserva a memória dos roteadores. Se "arquivo" não for nulo, as tabelas
+// ficam em um arquivo mapeado na memória em vez da memória comum.
+// Retorna NULL em caso de erro.
+roteador * aloca_roteadores(const char * arquivo);
+
+// Libera a memória reservada por aloca_roteadores().
+void libera_roteadores(roteador *);
+
+// Define custo infinito para todas as rotas e esvazia os buffers.
+void inicia_tabelas(roteador *);
+
+// Carrega enlaces, custos e nomes de um arquivo binário de topologia.
+// Retorna 0 em caso de sucesso ou -1 se o arquivo não puder ser usado.
+int carrega_topologia(roteador *, const char * arquivo);
+
+// Converte uma lista de enlaces em texto para o formato binário de topologia.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int converte_topologia(const char * entrada, const char * saida);
+
 // Função que realmente preenche os custos.
 void _preencher_enlaces(roteador *, int src, int dst, int custo);
 
@@ -176,107 +565,772 @@ int envia_pacotes(roteador *, int src);
 // Retorna a quantidade de mudanças na tabela de roteamento.
 int recebe_pacote(roteador *, int dst);
 
+// Sorteia quantos passos um roteador aguardará até o próximo envio.
+// "inicial" indica o primeiro sorteio, que define a fase do roteador.
+int sorteia_intervalo(int inicial);
+
+// Executa a parte de um roteador que depende do tempo: conta o intervalo
+// e envia os pacotes quando ele termina. Retorna os pacotes dropados.
+int executa_roteador(roteador *, int r_idx);
+
+// Avança a simulação em um passo: todos os roteadores executam e depois
+// processam os pacotes recebidos. Soma os pacotes dropados em *pkt_drop.
+// Retorna a quantidade de mudanças nas tabelas de roteamento.
+int executa_passo(roteador *, int * pkt_drop);
+
 // Printa os custos atuais entre roteadores.
 void printa_rotas(roteador *);
 
-// Desenha roteadores e seus enlaçes.
-// Esta função não acompanharia mudanças na matriz de conexões (o desenho é estático).
+// Calcula do zero as distâncias de referência a partir de custos_enlaces.
+void oraculo_inicializa(void);
+
+// Altera o custo de um enlace e atualiza apenas as distâncias de referência afetadas.
+// Retorna a quantidade de pares (origem, destino) cuja distância mudou.
+int oraculo_altera_enlace(int src, int dst, int custo);
+
+// Compara as tabelas dos roteadores com as distâncias de referência.
+// Retorna a quantidade de rotas divergentes.
+int verifica_rotas(roteador *);
+
+// Retorna um relógio monotônico em segundos.
+double relogio(void);
+
+// Retorna a memória residente do processo, em bytes.
+long memoria_residente(void);
+
+// Cria as threads auxiliares da fase de recebimento (quando n_threads > 1).
+void inicia_threads(void);
+
+// Processa os pacotes de todos os roteadores, divididos entre as threads.
+// Retorna a soma das mudanças nas tabelas de roteamento.
+int recebe_pacotes_paralelo(roteador *);
+
+// Encerra as threads auxiliares e imprime a eficiência paralela obtida.
+void finaliza_threads(void);
+
+// Escolhe entre o recebimento paralelo (1) e o sequencial de referência (0).
+void seleciona_motor(int paralelo);
+
+// Sorteia "amostra" destinos para o modo de amostragem.
+void sorteia_destinos(int amostra);
+
+// Imprime as estimativas de convergência e de mensagens do modo de amostragem.
+void relata_amostragem(int passos);
+
+// Cria um arquivo de exportação colunar e escreve seu cabeçalho.
+// Retorna NULL em caso de erro.
+FILE * abre_exportacao(const char * arquivo);
+
+// Acrescenta ao arquivo de exportação um retrato das tabelas no passo indicado.
+void exporta_tabelas(FILE *, roteador *, int passo);
+
+// Completa o cabeçalho com a quantidade de retratos e fecha o arquivo.
+void fecha_exportacao(FILE *);
+
+// Inicia o servidor HTTP de métricas em 127.0.0.1 na porta indicada.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int inicia_servidor_metricas(int porta);
+
+// Publica os contadores do passo para o servidor de métricas.
+void publica_metricas(long passos, long relaxacoes, long pacotes_descartados);
+
+// Cria a região de memória compartilhada com o nome indicado (ex.: /vetor_distancia).
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int inicia_estado_compartilhado(const char * nome);
+
+// Publica as tabelas alteradas e as métricas do passo na memória compartilhada.
+void publica_estado(roteador *);
+
+// Escreve um quadro PPM "prefixo_passo.ppm" com o mapa de calor das tabelas.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int exporta_quadro(roteador *, const char * prefixo, int passo);
+
+// Imprime a memória necessária para a simulação e a recomendação de layout.
+// Retorna a estimativa, em bytes.
+long planeja_memoria(void);
+
+// Compara a estimativa de memória com o pico de memória residente medido.
+void relata_memoria(long estimativa, long residente_inicial);
+
+// Abre um socket UDP por roteador em 127.0.0.1, nas portas porta_base+id.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int inicia_emulacao_udp(int porta_base);
+
+// Envia um pacote pela rede emulada a todos os vizinhos do remetente.
+// Retorna a quantidade de pacotes que não puderam ser enviados.
+int envia_udp(const pacote_t *, int src);
+
+// Submete de uma vez os envios enfileirados no io_uring e aguarda sua conclusão.
+// Retorna a quantidade de pacotes que não puderam ser enviados.
+int descarrega_envios_udp(void);
+
+// Move os datagramas recebidos para os buffers de entrada dos roteadores.
+// Retorna a quantidade de pacotes dropados (por motivos de buffer cheio).
+int recebe_udp(roteador *);
+
+// Imprime a vazão obtida pela emulação UDP.
+void relata_emulacao_udp(void);
+
+// Fecha os sockets, o epoll e o anel; os pacotes voltam a ser trocados em memória.
+void finaliza_emulacao_udp(void);
+
+// Gera uma topologia conexa aleatória, com custos, a partir da semente.
+void gera_topologia(unsigned semente);
+
+// Preenche as tabelas a partir de custos_enlaces, sem alterar os custos.
+void tabelas_de_custos(roteador *);
+
+// Calcula um hash das rotas de um roteador.
+uint64_t hash_roteador(roteador *, int r_idx);
+
+// Executa o motor de referência e o paralelo lado a lado em topologias geradas.
+// Retorna a quantidade de rodadas em que houve divergência.
+int executa_diferencial(int rodadas, unsigned semente);
+
+// Calcula um hash da topologia, dos custos e dos parâmetros que afetam o desempenho.
+uint64_t hash_topologia(void);
+
+// Mede a topologia, calibra as quantidades de threads e define n_threads com a
+// mais rápida. O perfil escolhido é guardado em "arquivo", indexado pelo hash
+// da topologia, e reaproveitado nas execuções seguintes.
+void autoajusta(const char * arquivo);
+
+// Calcula a chave do cache de estados convergidos: topologia, custos, INFINITO,
+// opções do protocolo, destinos simulados e semente.
+uint64_t chave_convergido(unsigned semente);
+
+// Mapeia na memória o estado convergido guardado no cache com a chave indicada
+// e preenche o passo final e as relaxações. Retorna NULL se não houver.
+roteador * carrega_convergido(const char * diretorio, uint64_t chave, int * passo, long * relaxacoes);
+
+// Guarda o estado convergido no cache. Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int salva_convergido(const char * diretorio, uint64_t chave, roteador *, int passo, long relaxacoes);
+
+// Desfaz o mapeamento feito por carrega_convergido().
+void libera_convergido(roteador *);
+
+// Altera o custo do enlace src -> dst durante a simulação. Custos a partir de
+// INFINITO derrubam o enlace. Atualiza a adjacência, a rota direta de src e as
+// distâncias de referência. Retorna a quantidade de distâncias de referência alteradas.
+int altera_enlace(roteador *, int src, int dst, int custo);
+
+// Simula a partir de "passo" até que as tabelas fiquem estáveis por ESTADO_ESTATICO
+// passos. Soma os pacotes dropados em *pkt_drop e as mudanças em *relaxacoes.
+// Retorna o último passo com mudanças, ou passo-1 se nada mudou.
+int simula_ate_convergir(roteador *, int passo, int * pkt_drop, long * relaxacoes);
+
+// Retorna o ID do roteador com o nome indicado, ou -1 se não existir.
+int roteador_do_nome(const char * nome);
+
+// Converte o custo de um enlace ("inf" ou um inteiro de 1 a INFINITO-1).
+// Retorna o custo, ou -1 se o texto não for um custo válido.
+int le_custo(const char * texto);
+
+// Aplica cada cenário do arquivo (linhas "A B custo") em um processo filho, a
+// partir do estado convergido, e relata a reconvergência de cada um.
+// Retorna a quantidade de cenários que não conferiram com a referência.
+int ramifica_cenarios(roteador *, const char * arquivo, int passo);
+
+// Cria o arquivo de traço e grava o estado inicial das tabelas.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int abre_traco(const char * arquivo, roteador *);
+
+// Grava no traço as rotas alteradas no passo (e um quadro-chave, se for a hora).
+void grava_passo_traco(roteador *, int passo);
+
+// Grava no traço uma alteração de enlace (sem efeito se não houver traço aberto).
+void grava_enlace_traco(int src, int dst, int custo);
+
+// Grava um quadro-chave final, o índice dos quadros-chave e os nomes e fecha o traço.
+void fecha_traco(roteador *, int ultimo_passo);
+
+// Abre um traço gravado e lê comandos de depuração da entrada padrão.
+// Retorna 0 em caso de sucesso ou -1 se o arquivo não puder ser usado.
+int depura_traco(const char * arquivo);
+
+// Lê um roteiro. As configurações (topologia, semente, intervalos) são aplicadas
+// na hora; a linha do tempo é guardada para compila_roteiro().
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int le_roteiro(const char * arquivo);
+
+// Converte a linha do tempo do roteiro no vetor de eventos, já com a topologia
+// carregada. Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int compila_roteiro(void);
+
+// Aplica os eventos do roteiro marcados para o passo.
+// Retorna a quantidade de alterações de enlace aplicadas.
+int aplica_eventos(roteador *, int passo, int pkt_drop);
+
+// Retorna 1 se ainda há eventos do roteiro a aplicar.
+int eventos_pendentes(void);
+
+// Acompanha as mudanças de cada passo para as medidas do roteiro.
+void acompanha_roteiro(int passo, int delta);
+
+// Imprime as medidas do roteiro e confere suas afirmações.
+// Retorna a quantidade de afirmações que falharam.
+int avalia_roteiro(roteador *, int passo, int pkt_drop);
+
+// Preenche todos os enlaces do diagrama com DISTANCIA_AUTOMATICA, sem perguntar.
+void enlaces_automaticos(roteador *);
+
+// Marca que a tabela do roteador mudou e uma atualização disparada é devida.
+void agenda_disparo(roteador *, int r_idx);
+
+// Imprime o efeito das atualizações disparadas: envios, agrupamentos, pico e descartes.
+void relata_disparos(int pkt_drop);
+
+// Prepara a tabela de decaimento do amortecimento.
+void inicia_amortecimento(void);
+
+// Aplica o amortecimento a uma mudança da rota de r_idx até "destino".
+// Retorna 1 se a rota passou a ser suprimida e a mudança deve ser ignorada.
+int amortece(int r_idx, int destino, int custo, int caminho, int piora);
+
+// Trata um anúncio para uma rota suprimida: enquanto a penalidade não cai
+// abaixo do reuso, ele só altera a rota guardada e retorna 1. Senão libera
+// a rota, somando em *delta se ela mudou, e retorna 0.
+int segue_suprimida(roteador *, int r_idx, int destino, int remetente, int custo, int * delta);
+
+// Libera as rotas suprimidas cuja penalidade já caiu abaixo do reuso,
+// aplicando os anúncios ignorados. Retorna quantas foram liberadas e
+// guarda em *restantes quantas continuam suprimidas.
+int libera_suprimidas(roteador *, int * restantes);
+
+// Imprime as supressões e os anúncios ignorados pelo amortecimento.
+void relata_amortecimento(void);
+
+// Calcula a posição de cada roteador em um quadrado unitário a partir dos enlaces.
+void calcula_layout(double * x, double * y);
+
+// Desenha roteadores e seus enlaçes, seguindo a matriz de conexões.
 void desenha_topologia();
 
+// Escreve a topologia em SVG, colorindo cada enlace pela quantidade de pacotes.
+// Retorna 0 em caso de sucesso ou -1 em caso de erro.
+int exporta_svg(const char * arquivo);
+
 
-int main(void){
+int main(int argc, char ** argv){
 	
-	srand(time(NULL));
-	roteador roteadores[N_ROTEADORES];
+	roteador * roteadores;
+	
+	/* Opções de linha de comando:
+	 * -t arquivo         carrega a topologia e os custos de um arquivo binário
+	 * -c texto binario   converte uma lista de enlaces para o formato binário
+	 * -m arquivo         mantém as tabelas dos roteadores em um arquivo mapeado
+	 * -s amostra         simula apenas "amostra" destinos sorteados
+	 * -e arquivo         exporta as tabelas finais em formato colunar
+	 * -x                 exporta também um retrato das tabelas a cada passo
+	 * -p porta           serve métricas no formato do Prometheus em 127.0.0.1
+	 * -S nome            publica o estado em memória compartilhada POSIX
+	 * -g arquivo         desenha a topologia em SVG ao final, com a carga dos enlaces
+	 * -f prefixo         escreve um quadro de mapa de calor por passo (prefixo_00000.ppm...)
+	 * -P                 mostra a estimativa de memória antes e a compara com a medida ao final
+	 * -u porta_base      troca os pacotes em formato RIPv2 por UDP no loopback
+	 * -T threads         quantidade de threads da fase de recebimento
+	 * -r semente         semente dos sorteios (o padrão é o horário atual)
+	 * -d rodadas         compara o motor paralelo com o de referência e sai
+	 * -a perfis          escolhe a quantidade de threads por calibração (perfis guardados no arquivo)
+	 * -k diretorio       reaproveita (ou guarda) o estado convergido em um cache no diretório
+	 * -b cenarios        após convergir, aplica cada cenário (linhas "A B custo") em um processo à parte
+	 * -G arquivo         grava um traço da execução para o depurador
+	 * -D arquivo         depura um traço gravado (ir a um passo, avançar, voltar, consultar rotas)
+	 * -E roteiro         executa um roteiro (eventos, medições e afirmações) sem interação
+	 * -A min:max         liga as atualizações disparadas, espaçadas de min a max passos
+	 * -B                 usa recuo exponencial nas atualizações disparadas
+	 * -F                 amortece rotas que oscilam (RFC 2439) */
+	char * arquivo_topologia = NULL;
+	char * arquivo_tabelas = NULL;
+	char * arquivo_exportacao = NULL;
+	FILE * exportacao = NULL;
+	int exporta_passos = 0;
+	int amostra = 0;
+	int porta_metricas = 0;
+	char * nome_estado = NULL;
+	char * arquivo_svg = NULL;
+	char * prefixo_quadros = NULL;
+	int planeja = 0;
+	long estimativa_memoria = 0, residente_inicial = 0;
+	int porta_udp = 0;
+	unsigned semente = time(NULL);
+	int semente_definida = 0;
+	int rodadas_diferencial = 0;
+	char * arquivo_perfis = NULL;
+	char * diretorio_cache = NULL;
+	char * arquivo_cenarios = NULL;
+	char * arquivo_traco = NULL;
+	char * arquivo_roteiro = NULL;
+	int falhas_roteiro = 0;
+	roteador * convergido = NULL;
+	uint64_t chave = 0;
+	int opcao;
+	
+	while((opcao = getopt(argc, argv, "t:c:m:s:e:xp:S:g:f:Pu:T:r:d:a:k:b:G:D:E:A:BF")) != -1)
+	{
+		switch(opcao)
+		{
+			case 'F':
+				amortecimento_ativo = 1;
+				break;
+			case 'A':
+				if(sscanf(optarg, "%d:%d", &disparo_espera_min, &disparo_espera_max) != 2 ||
+				   disparo_espera_min < 0 || disparo_espera_max < disparo_espera_min){
+					fprintf(stderr, "Uso: -A min:max (passos, 0 <= min <= max)\n");
+					return 1;
+				}
+				disparo_ativo = 1;
+				break;
+			case 'B':
+				disparo_recuo = 1;
+				break;
+			case 'E':
+				arquivo_roteiro = optarg;
+				break;
+			case 'G':
+				arquivo_traco = optarg;
+				break;
+			case 'D':
+				return depura_traco(optarg) ? 1 : 0;
+			case 'b':
+				arquivo_cenarios = optarg;
+				break;
+			case 'k':
+				diretorio_cache = optarg;
+				break;
+			case 'a':
+				arquivo_perfis = optarg;
+				break;
+			case 'T':
+				n_threads = atoi(optarg);
+				break;
+			case 'r':
+				semente = strtoul(optarg, NULL, 10);
+				semente_definida = 1;
+				break;
+			case 'd':
+				rodadas_diferencial = atoi(optarg);
+				break;
+			case 'u':
+				porta_udp = atoi(optarg);
+				break;
+			case 'P':
+				planeja = 1;
+				break;
+			case 'f':
+				prefixo_quadros = optarg;
+				break;
+			case 'g':
+				arquivo_svg = optarg;
+				break;
+			case 'S':
+				nome_estado = optarg;
+				break;
+			case 'p':
+				porta_metricas = atoi(optarg);
+				break;
+			case 'e':
+				arquivo_exportacao = optarg;
+				break;
+			case 'x':
+				exporta_passos = 1;
+				break;
+			case 's':
+				amostra = atoi(optarg);
+				if(amostra < 1 || amostra > N_ROTEADORES){
+					fprintf(stderr, "A amostra deve ter entre 1 e %d destinos.\n", N_ROTEADORES);
+					return 1;
+				}
+				break;
+			case 't':
+				arquivo_topologia = optarg;
+				break;
+			case 'm':
+				arquivo_tabelas = optarg;
+				break;
+			case 'c':
+				if(optind >= argc){
+					fprintf(stderr, "Uso: %s -c lista.txt topologia.bin\n", argv[0]);
+					return 1;
+				}
+				return converte_topologia(optarg, argv[optind]) ? 1 : 0;
+			default:
+				fprintf(stderr, "Uso: %s [-t topologia.bin] [-c lista.txt topologia.bin] [-m tabelas.bin] [-s amostra] [-e tabelas.col [-x]] [-p porta] [-S /nome] [-g topologia.svg] [-f prefixo] [-P] [-u porta_base] [-T threads] [-r semente] [-d rodadas] [-a perfis] [-k diretorio] [-b cenarios] [-G traco] [-D traco] [-E roteiro] [-A min:max [-B]] [-F]\n", argv[0]);
+				return 1;
+		}
+	}
+	
+	/* As opções da linha de comando têm precedência sobre o roteiro. */
+	if(arquivo_roteiro){
 		
-	system("clear");
-	printf("Simulador de algoritmo vetor de distância\n");
-	printf("Filipe Nicoli - Teoria de Redes - 2016/1\n\n");
+		if(le_roteiro(arquivo_roteiro))
+			return 1;
 		
-	printf("Topologia de conexão dos roteadores:\n\n");
+		if(!arquivo_topologia)
+			arquivo_topologia = roteiro_topologia;
+		if(!semente_definida && roteiro_semente >= 0)
+			semente = roteiro_semente;
+		
+		/* O cache guarda apenas a convergência inicial, sem eventos. */
+		if(diretorio_cache){
+			fprintf(stderr, "O cache de estados convergidos (-k) é ignorado com um roteiro.\n");
+			diretorio_cache = NULL;
+		}
+	}
+	
+	srand(semente);
+	inicia_amortecimento();
 	
+	if(rodadas_diferencial){
+		inicia_threads();
+		opcao = executa_diferencial(rodadas_diferencial, semente);
+		finaliza_threads();
+		return opcao ? 1 : 0;
+	}
+	
+	roteadores = aloca_roteadores(arquivo_tabelas);
+	if(!roteadores)
+		return 1;
+	
+	if(porta_metricas && inicia_servidor_metricas(porta_metricas))
+		return 1;
+	
+	if(nome_estado && inicia_estado_compartilhado(nome_estado))
+		return 1;
+	
+	if(porta_udp && inicia_emulacao_udp(porta_udp))
+		return 1;
+	
+	if(!arquivo_roteiro)
+		system("clear");
+	printf("Simulador de algoritmo vetor de distância\n");
+	printf("Filipe Nicoli - Teoria de Redes - 2016/1\n\n");
 	
-	// Desenha o esquema de roteadores na tela
-	desenha_topologia();
+	if(arquivo_topologia){
+		
+		if(carrega_topologia(roteadores, arquivo_topologia))
+			return 1;
+		
+		desenha_topologia();
+		
+	}else if(arquivo_roteiro){
+		
+		enlaces_automaticos(roteadores);
+		desenha_topologia();
+		
+	}else{
+		
+		printf("Topologia de conexão dos roteadores:\n\n");
+		
 		
-	printf("Preencha os custos de transmissão entre cada roteador:\n");
-	preencher_enlaces(roteadores);
+		// Desenha o esquema de roteadores na tela
+		desenha_topologia();
+			
+		printf("Preencha os custos de transmissão entre cada roteador:\n");
+		preencher_enlaces(roteadores);
 
-	printf("Pressione ENTER para iniciar a simulação.");
-	while(getchar()!='\n');
-	getchar();
+		printf("Pressione ENTER para iniciar a simulação.");
+		while(getchar()!='\n');
+		getchar();
+	}
+	
+	oraculo_inicializa();
+	sorteia_destinos(amostra);
+	
+	/* O cabeçalho da exportação leva o número de linhas por retrato, que
+	 * depende dos destinos sorteados. */
+	if(arquivo_exportacao){
+		exportacao = abre_exportacao(arquivo_exportacao);
+		if(!exportacao)
+			return 1;
+	}
+	
+	if(arquivo_roteiro && compila_roteiro())
+		return 1;
+	
+	if(arquivo_perfis)
+		autoajusta(arquivo_perfis);
+	
+	inicia_threads();
+	
+	if(planeja){
+		residente_inicial = memoria_residente();
+		estimativa_memoria = planeja_memoria();
+	}
 	
 	/* Armazenam a contagem de mudanças nas tabelas de roteamento.
 	 * São usadas para definir quando o algoritmo chega ao fim. */
 	int delta = 0;
 	int passo = 0;
 	int ultimo_passo_com_variacao = 0;
+	int suprimidas, fim;
 	
 	int pkt_drop = 0;
+	long relaxacoes = 0;
 	
 	int r_idx;
 	
-	// Escolhe um intervalo aleatório inicial entre 0 e 4 para envio de pacote daquele roteador
+	// Escolhe um intervalo inicial para envio de pacote daquele roteador
 	for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++)
-		roteadores[r_idx].intervalo = (int) (((float)random()/(float)RAND_MAX)*(float)5);
+		roteadores[r_idx].intervalo = sorteia_intervalo(1);
+	
+	/* Com o estado no cache, a convergência inicial é pulada. */
+	if(diretorio_cache){
+		chave = chave_convergido(semente);
+		convergido = carrega_convergido(diretorio_cache, chave, &passo, &relaxacoes);
+		if(convergido){
+			libera_roteadores(roteadores);
+			roteadores = convergido;
+			publica_metricas(passo + 1, relaxacoes, pkt_drop);
+			publica_estado(roteadores);
+		}
+	}
+	
+	if(arquivo_traco && !convergido && abre_traco(arquivo_traco, roteadores))
+		return 1;
 	
-	while(1)
+	while(!convergido)
 	{
-		system("clear");
-		printf("Simulando... (passo %d) (pkt_drop: %d) (delta anterior: %d)\n\n", passo, pkt_drop, delta);
-		printa_rotas(roteadores);
+		passo_atual = passo;
 		
-		delta = 0;
-			
-		// Para cada roteador, determina se é hora de enviar novos pacotes
-		for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++)
-		{
-			if(roteadores[r_idx].intervalo)
-			{
-				roteadores[r_idx].intervalo -= 1;
-			}else{
-				pkt_drop += envia_pacotes(roteadores, r_idx);
-				roteadores[r_idx].intervalo = (int) (((float)random()/(float)RAND_MAX)*5);			
-			}
-			
+		/* Uma alteração de enlace conta como variação: a rede precisa de
+		 * ESTADO_ESTATICO passos estáveis depois dela. */
+		if(arquivo_roteiro && aplica_eventos(roteadores, passo, pkt_drop))
+			ultimo_passo_com_variacao = passo;
+		
+		if(!arquivo_roteiro){
+			system("clear");
+			printf("Simulando... (passo %d) (pkt_drop: %d) (delta anterior: %d)\n\n", passo, pkt_drop, delta);
+			printa_rotas(roteadores);
 		}
 		
+		delta = executa_passo(roteadores, &pkt_drop);
+		relaxacoes += delta;
+		
+		if(delta) ultimo_passo_com_variacao = passo;
 		
-		// Para cada pacote, verifica se novos pacotes chegaram e altera suas opções de rota de acordo
-		for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++){
-			delta += recebe_pacote(roteadores, r_idx);
+		/* Com a rede parada, as rotas suprimidas que já podem ser usadas são
+		 * liberadas; isso é uma mudança, e a simulação continua. Só termina
+		 * quando não resta nenhuma. A liberação faz parte do passo, então
+		 * acontece antes de ele ser exportado e gravado no traço. */
+		fim = 0;
+		if( passo - ultimo_passo_com_variacao >= ESTADO_ESTATICO && !eventos_pendentes() ){
+			if(libera_suprimidas(roteadores, &suprimidas))
+				ultimo_passo_com_variacao = passo;
+			else if(!suprimidas)
+				fim = 1;
 		}
 		
+		if(arquivo_roteiro)
+			acompanha_roteiro(passo, delta);
+		publica_metricas(passo + 1, relaxacoes, pkt_drop);
+		publica_estado(roteadores);
 		
-		if(delta) ultimo_passo_com_variacao = passo;
-				
-		if( passo - ultimo_passo_com_variacao >= ESTADO_ESTATICO ) break;
+		if(exportacao && exporta_passos)
+			exporta_tabelas(exportacao, roteadores, passo);
+		
+		if(prefixo_quadros)
+			exporta_quadro(roteadores, prefixo_quadros, passo);
+		
+		if(arquivo_traco)
+			grava_passo_traco(roteadores, passo);
+		
+		if(fim)
+			break;
 		
 		// Aguarda 1/2 de segundo para que o usuário consiga perceber as variações
-		usleep(TEMPO_DE_PASSO);
+		if(!arquivo_roteiro)
+			usleep(TEMPO_DE_PASSO);
 		
 		passo++;
 	}
 	
+	finaliza_threads();
+	
+	if(diretorio_cache && !convergido)
+		salva_convergido(diretorio_cache, chave, roteadores, passo, relaxacoes);
+	
+	if(arquivo_traco && !convergido)
+		fecha_traco(roteadores, passo);
+	
 	printf("Algoritmo finalizado. Custos ideais encontradas em %d passos.\n", passo-ESTADO_ESTATICO);
 	
+	if(n_destinos < N_ROTEADORES)
+		relata_amostragem(passo-ESTADO_ESTATICO);
+	
+	if(exportacao){
+		/* Vindo do cache, o laço não executou e nenhum passo foi exportado:
+		 * a tabela carregada é exportada como o único instantâneo. */
+		if(!exporta_passos || convergido)
+			exporta_tabelas(exportacao, roteadores, passo);
+		fecha_exportacao(exportacao);
+	}
+	
+	if(arquivo_svg)
+		exporta_svg(arquivo_svg);
+	
+	if(verifica_rotas(roteadores))
+		printf("As tabelas divergem das distâncias de referência.\n");
+	else
+		printf("Tabelas conferidas com as distâncias de referência.\n");
+	
+	if(arquivo_roteiro)
+		falhas_roteiro = avalia_roteiro(roteadores, passo, pkt_drop);
+	
+	if(arquivo_cenarios)
+		ramifica_cenarios(roteadores, arquivo_cenarios, passo + 1);
+	
+	if(planeja)
+		relata_memoria(estimativa_memoria, residente_inicial);
+	
+	if(porta_udp){
+		relata_emulacao_udp();
+		finaliza_emulacao_udp();
+	}
+	
+	if(disparo_ativo || arquivo_roteiro)
+		relata_disparos(pkt_drop);
+	
+	if(amortecimento_ativo)
+		relata_amortecimento();
+	
+	if(convergido)
+		libera_convergido(convergido);
+	else
+		libera_roteadores(roteadores);
+	
 	printf("Fim.\n");
-	return 0;
+	return falhas_roteiro ? 1 : 0;
 }
 
-int recebe_pacote(roteador * r, int dst){
-
-	/* Trata os pacotes até que não haja mais nenhum no buffer. */
-
-	int pacote;					// posição do pacote na pilha
-	int remetente;				// remetente do pacote
-	int custo_atual;			// custo atual até o destino sugerido pela rota de um pacote
-	int custo_remetente;		// custo até o remetente do pacote
-	int custo_rota_pacote;		// custo da rota sugerida
-	int destino_rota_pacote;	// destino da rota sugerida
-
-	int delta = 0;
-	int rota_idx;
+int sorteia_intervalo(int inicial){
+	
+	/* random() % n tem um viés desprezível para os valores pequenos usados
+	 * aqui, e nunca produz n (o que acontecia ao escalar por RAND_MAX). */
+	
+	int variacao, intervalo;
+	
+	switch(distribuicao_intervalo){
+		
+		case INTERVALO_UNIFORME:
+			/* Os parâmetros já são validados; o limite só garante que um
+			 * intervalo negativo (que nunca chegaria a zero) não apareça. */
+			variacao = intervalo_periodo * intervalo_jitter / 100;
+			intervalo = intervalo_periodo - variacao + (int)(random() % (2*variacao + 1));
+			return intervalo < 0 ? 0 : intervalo;
+		
+		case INTERVALO_EXPONENCIAL:
+			/* Conta fracassos de uma moeda com probabilidade de sucesso
+			 * 1/(periodo+1), cuja média é o período. */
+			intervalo = 0;
+			while(random() % (intervalo_periodo + 1) != 0)
+				intervalo++;
+			return intervalo;
+		
+		case INTERVALO_PERIODICO:
+			if(inicial)
+				return (int)(random() % (intervalo_periodo + 1));
+			return intervalo_periodo;
+		
+		case INTERVALO_FIXO:
+		default:
+			return intervalo_periodo;
+	}
+}
+
+int executa_roteador(roteador * r, int r_idx){
+	
+	/* O comportamento de um roteador no tempo fica concentrado aqui: ele
+	 * aguarda o fim do seu intervalo, envia seus pacotes e sorteia um novo
+	 * intervalo. Variações do protocolo (temporizadores, atualizações
+	 * disparadas) devem ser adicionadas nesta função. O processamento dos
+	 * pacotes recebidos fica em recebe_pacote(). */
+	
+	int pkt_drop = 0;
+	roteador * rt = &r[r_idx];
+	
+	if(disparo_ativo && rt->espera_disparo > 0){
+		rt->espera_disparo--;
+		if(rt->espera_disparo == 0 && !rt->disparo_pendente)
+			rt->nivel_disparo = 0;
+	}
+	
+	if(rt->intervalo)
+	{
+		rt->intervalo -= 1;
+		
+		/* Atualização disparada: a tabela mudou e a espera acabou. Ela não
+		 * altera o intervalo do envio periódico. */
+		if(rt->disparo_pendente && rt->espera_disparo == 0){
+			pkt_drop += envia_pacotes(r, r_idx);
+			disparos_enviados++;
+			rt->disparo_pendente = 0;
+			rt->espera_disparo = (disparo_espera_min + (int)(random() % (disparo_espera_max - disparo_espera_min + 1))) << rt->nivel_disparo;
+			if(disparo_recuo && rt->nivel_disparo < DISPARO_NIVEL_MAXIMO)
+				rt->nivel_disparo++;
+		}
+	}else{
+		/* O envio periódico leva as mudanças pendentes. */
+		pkt_drop += envia_pacotes(r, r_idx);
+		rt->intervalo = sorteia_intervalo(0);
+		rt->disparo_pendente = 0;
+	}
+	
+	return pkt_drop;
+}
+
+int executa_passo(roteador * r, int * pkt_drop){
+	
+	int r_idx, delta;
+	long mensagens = pacotes_enviados + *pkt_drop;
+	double t0 = relogio();
+	
+	// Para cada roteador, determina se é hora de enviar novos pacotes
+	for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++)
+		*pkt_drop += executa_roteador(r, r_idx);
+	
+	/* Na emulação os pacotes estão nos sockets e precisam ser trazidos
+	 * para os buffers de entrada antes do processamento. */
+	if(emulacao_udp){
+		*pkt_drop += descarrega_envios_udp();
+		*pkt_drop += recebe_udp(r);
+	}
+	
+	ocupacao_entradas = 0;
+	for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++)
+		ocupacao_entradas += r[r_idx].idx;
+	
+	tempo_envio += relogio() - t0;
+	
+	mensagens = pacotes_enviados + *pkt_drop - mensagens;
+	if(mensagens > pico_mensagens)
+		pico_mensagens = mensagens;
+	
+	// Para cada pacote, verifica se novos pacotes chegaram e altera suas opções de rota de acordo
+	delta = recebe_pacotes_paralelo(r);
+	
+	if(disparo_ativo)
+		for(r_idx = 0; r_idx < N_ROTEADORES; r_idx++)
+			if(alterado_no_recebimento[r_idx])
+				agenda_disparo(r, r_idx);
+	
+	return delta;
+}
+
+int recebe_pacote(roteador * r, int dst){
+
+	/* Trata os pacotes até que não haja mais nenhum no buffer. */
+
+	int pacote;					// posição do pacote na pilha
+	int remetente;				// remetente do pacote
+	int custo_atual;			// custo atual até o destino sugerido pela rota de um pacote
+	int custo_remetente;		// custo até o remetente do pacote
+	int custo_rota_pacote;		// custo da rota sugerida
+	int destino_rota_pacote;	// destino da rota sugerida
+	int custo_novo;				// custo até o destino usando o remetente como caminho
+
+	int delta = 0;
+	int rota_idx;
 		
 	// Enquanto houverem pacotes a serem recebidos, roda o loop
 	while(r[dst].idx!=0)
@@ -284,7 +1338,7 @@ int recebe_pacote(roteador * r, int dst){
 		
 		r[dst].idx--;
 		
-		for(rota_idx=0; rota_idx<N_ROTEADORES; rota_idx++){
+		for(rota_idx=0; rota_idx<n_destinos; rota_idx++){
 
 			/* Se o custo da rota que possuímos para o destino especificado pela rota do pacote for
 			 * superior ao custo que a rota do pacote apresenta + o custo até o remetente, quer
@@ -295,22 +1349,53 @@ int recebe_pacote(roteador * r, int dst){
 			destino_rota_pacote = r[dst].entrada[ pacote ].rotas[ rota_idx ].destino;	// destino da rota "rota_idx" presente no pacote "pacote"
 			custo_atual         = r[dst].rotas[ destino_rota_pacote ].custo;			// custo atual até o destino sugerido pela rota
 			remetente           = r[dst].entrada[ pacote ].remetente;					// remetente do pacote
-			custo_remetente     = r[dst].rotas[ remetente ].custo;						// custo até o remetente da mensagem
+			custo_remetente     = custos_enlaces[dst][remetente];						// custo do enlace até o remetente da mensagem
 			custo_rota_pacote   = r[dst].entrada[ pacote ].rotas[ rota_idx ].custo;		// custo da rota sugerida
 			
-			if( custo_atual > (custo_rota_pacote + custo_remetente) )
+			/* O custo até o remetente é o do enlace, e não o da nossa rota até ele:
+			 * a rota pode passar por outro caminho, ou não ser simulada na
+			 * amostragem, e com enlaces que mudam ela pode estar desatualizada.
+			 * Pelo mesmo motivo o remetente está sempre a 0 de si mesmo, qualquer
+			 * que seja a rota que ele guarda para si. */
+			if(destino_rota_pacote == remetente)
+				custo_rota_pacote = 0;
+			
+			/* Custos a partir de INFINITO significam destino inacessível. */
+			custo_novo = custo_rota_pacote + custo_remetente;
+			if(custo_novo > INFINITO) custo_novo = INFINITO;
+			
+			/* Anúncios para uma rota suprimida só alteram a rota guardada
+			 * para a liberação, até que a penalidade caia. */
+			if(amortecimento_ativo && rota_suprimida[dst][destino_rota_pacote]){
+				if(segue_suprimida(r, dst, destino_rota_pacote, remetente, custo_novo, &delta))
+					continue;
+				custo_atual = r[dst].rotas[ destino_rota_pacote ].custo;
+			}
+			
+			if( custo_atual > custo_novo ||
+			    (r[dst].rotas[ destino_rota_pacote ].caminho == remetente && custo_atual != custo_novo) )
 			
 			/* Se o custo atual for maior que o custo até o destino (utilizando o remetente como caminho),
-			 * utilizaremos a rota sugerida e utilizaremos o remetente da mensagem como ponte. */
+			 * utilizaremos a rota sugerida e utilizaremos o remetente da mensagem como ponte.
+			 * Se o remetente já é o nosso caminho, aceitamos também uma piora: o custo anunciado
+			 * por ele é o único válido para esta rota (é assim que falhas se propagam). */
 			
 			{
+				
+				/* Com o amortecimento, pioras frequentes suprimem a rota. Só é
+				 * consultado quando há mudança, então redes estáveis não pagam
+				 * nada por ele. */
+				if(amortecimento_ativo && amortece(dst, destino_rota_pacote, custo_novo,
+				                                   custo_novo == INFINITO ? -1 : remetente, custo_novo > custo_atual))
+					continue;
 
 				/* Copiamos o remetente como caminho mais curto até o destino. */
-				r[dst].rotas[ destino_rota_pacote ].caminho = remetente;
+				r[dst].rotas[ destino_rota_pacote ].caminho = custo_novo == INFINITO ? -1 : remetente;
 
 				/* Copiamos o custo e somamos o custo até o vizinho remetente, pois além da distância
 				 * de nosso vizinho até o destino, precisamos dar um pulo até o vizinho primeiro. */
-				r[dst].rotas[ destino_rota_pacote ].custo   = custo_rota_pacote + custo_remetente;
+				r[dst].rotas[ destino_rota_pacote ].custo   = custo_novo;
+				ultima_mudanca[dst][ destino_rota_pacote ] = passo_atual;
 				
 				/* Quando terminarmos de analisar todas as rotas de todos os pacotes,
 				 * avisaremos o loop principar de que realizamos mudanças na tabela
@@ -324,9 +1409,251 @@ int recebe_pacote(roteador * r, int dst){
 	return delta;
 }
 
+/* Dimensões da área de desenho em caracteres. Como um caractere é mais
+ * alto que largo, a largura é o dobro da altura. */
+#define DESENHO_LARGURA 56
+#define DESENHO_ALTURA 15
+
+/* Retorna 1 se existe enlace entre i e j em algum dos sentidos. */
+static int conectados(int i, int j){
+	
+	int k;
+	
+	for(k=0; k<N_ROTEADORES; k++)
+		if(conexoes_enlaces[i][k] == j || conexoes_enlaces[j][k] == i)
+			return 1;
+	
+	return 0;
+}
+
+void calcula_layout(double * x, double * y){
+	
+	/* Layout por forças (Fruchterman-Reingold): todos os roteadores se
+	 * repelem e os enlaces atraem suas pontas, com um deslocamento máximo
+	 * ("temperatura") que diminui a cada iteração. As posições iniciais
+	 * seguem uma busca em largura a partir do primeiro roteador: cada
+	 * camada (distância em pulos) é uma coluna. Isto evita boa parte dos
+	 * cruzamentos e torna o desenho sempre o mesmo para a mesma topologia.
+	 * Com a quantidade de roteadores fixa em tempo de compilação, a
+	 * repulsão calculada par a par é suficiente. */
+	
+	double dx[N_ROTEADORES], dy[N_ROTEADORES];
+	double k = sqrt(1.0 / N_ROTEADORES);
+	double temperatura = 0.1;
+	double ddx, ddy, dist, forca;
+	double xmin, xmax, ymin, ymax;
+	double cxm, cym, sxx, syy, sxy, angulo;
+	int camada[N_ROTEADORES], ocupacao[N_ROTEADORES], fila[N_ROTEADORES];
+	int inicio_fila, fim_fila, n_camadas = 0;
+	int i, j, iteracao;
+	
+	// Busca em largura; roteadores inalcançáveis ficam numa camada extra
+	for(i=0; i<N_ROTEADORES; i++)
+		camada[i] = -1;
+	camada[0] = 0;
+	fila[0] = 0;
+	inicio_fila = 0;
+	fim_fila = 1;
+	while(inicio_fila < fim_fila){
+		i = fila[inicio_fila++];
+		for(j=0; j<N_ROTEADORES; j++)
+			if(camada[j] == -1 && conectados(i, j)){
+				camada[j] = camada[i] + 1;
+				if(camada[j] > n_camadas) n_camadas = camada[j];
+				fila[fim_fila++] = j;
+			}
+	}
+	for(i=0; i<N_ROTEADORES; i++)
+		if(camada[i] == -1)
+			camada[i] = n_camadas + 1;
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		ocupacao[i] = 0;
+		for(j=0; j<i; j++)
+			if(camada[j] == camada[i])
+				ocupacao[i]++;
+		x[i] = camada[i] * k;
+		y[i] = ocupacao[i] * k;
+	}
+	
+	for(iteracao=0; iteracao<300; iteracao++){
+		
+		for(i=0; i<N_ROTEADORES; i++){
+			
+			dx[i] = dy[i] = 0;
+			
+			for(j=0; j<N_ROTEADORES; j++){
+				
+				if(i == j) continue;
+				
+				ddx = x[i] - x[j];
+				ddy = y[i] - y[j];
+				dist = sqrt(ddx*ddx + ddy*ddy) + 1e-9;
+				
+				// Repulsão entre todos os pares
+				forca = k * k / dist;
+				
+				// Atração entre vizinhos
+				if(conectados(i, j))
+					forca -= dist * dist / k;
+				
+				dx[i] += ddx / dist * forca;
+				dy[i] += ddy / dist * forca;
+			}
+		}
+		
+		for(i=0; i<N_ROTEADORES; i++){
+			dist = sqrt(dx[i]*dx[i] + dy[i]*dy[i]) + 1e-9;
+			if(dist > temperatura) dist /= temperatura; else dist = 1;
+			x[i] += dx[i] / dist;
+			y[i] += dy[i] / dist;
+		}
+		
+		temperatura *= 0.98;
+	}
+	
+	/* Gira o desenho para que a direção de maior espalhamento (eixo
+	 * principal) fique na horizontal, onde há mais espaço na tela. */
+	cxm = cym = 0;
+	for(i=0; i<N_ROTEADORES; i++){
+		cxm += x[i] / N_ROTEADORES;
+		cym += y[i] / N_ROTEADORES;
+	}
+	sxx = syy = sxy = 0;
+	for(i=0; i<N_ROTEADORES; i++){
+		sxx += (x[i]-cxm) * (x[i]-cxm);
+		syy += (y[i]-cym) * (y[i]-cym);
+		sxy += (x[i]-cxm) * (y[i]-cym);
+	}
+	angulo = 0.5 * atan2(2 * sxy, sxx - syy);
+	for(i=0; i<N_ROTEADORES; i++){
+		ddx = x[i] - cxm;
+		ddy = y[i] - cym;
+		x[i] =  ddx * cos(angulo) + ddy * sin(angulo);
+		y[i] = -ddx * sin(angulo) + ddy * cos(angulo);
+	}
+	
+	// Normaliza para o quadrado unitário
+	xmin = xmax = x[0];
+	ymin = ymax = y[0];
+	for(i=1; i<N_ROTEADORES; i++){
+		if(x[i] < xmin) xmin = x[i];
+		if(x[i] > xmax) xmax = x[i];
+		if(y[i] < ymin) ymin = y[i];
+		if(y[i] > ymax) ymax = y[i];
+	}
+	for(i=0; i<N_ROTEADORES; i++){
+		x[i] = (xmax > xmin) ? (x[i] - xmin) / (xmax - xmin) : 0.5;
+		y[i] = (ymax > ymin) ? (y[i] - ymin) / (ymax - ymin) : 0.5;
+	}
+}
+
 void desenha_topologia()
 {
-	printf("             B ------ D\n            /| \\      |\\\n           / |  \\     | \\\n          /  |   \\    |  \\\n         A   |    \\   |   F\n          \\  |     \\  |  /\n           \\ |      \\ | /\n            \\|       \\|/\n             C ------ E\n\n");
+	/* Os enlaces são traçados com o algoritmo de Bresenham, usando o
+	 * caractere mais próximo da inclinação de cada um. Os nomes dos
+	 * roteadores são escritos por cima. */
+	
+	char tela[DESENHO_ALTURA][DESENHO_LARGURA + 1];
+	double x[N_ROTEADORES], y[N_ROTEADORES];
+	int cx[N_ROTEADORES], cy[N_ROTEADORES];
+	int i, j, px, py, passo_x, passo_y, erro, e2, dx, dy;
+	char traco;
+	
+	calcula_layout(x, y);
+	
+	for(i=0; i<DESENHO_ALTURA; i++){
+		memset(tela[i], ' ', DESENHO_LARGURA);
+		tela[i][DESENHO_LARGURA] = '\0';
+	}
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		cx[i] = 1 + (int)(x[i] * (DESENHO_LARGURA - 3) + 0.5);
+		cy[i] = (int)(y[i] * (DESENHO_ALTURA - 1) + 0.5);
+	}
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=i+1; j<N_ROTEADORES; j++){
+			
+			if(!conectados(i, j)) continue;
+			
+			dx = abs(cx[j] - cx[i]);
+			dy = abs(cy[j] - cy[i]);
+			passo_x = cx[i] < cx[j] ? 1 : -1;
+			passo_y = cy[i] < cy[j] ? 1 : -1;
+			
+			if(2*dy < dx)       traco = '-';
+			else if(2*dx < dy)  traco = '|';
+			else if(passo_x == passo_y) traco = '\\';
+			else                traco = '/';
+			
+			px = cx[i];
+			py = cy[i];
+			erro = dx - dy;
+			
+			while(px != cx[j] || py != cy[j]){
+				e2 = 2 * erro;
+				if(e2 > -dy){ erro -= dy; px += passo_x; }
+				if(e2 <  dx){ erro += dx; py += passo_y; }
+				tela[py][px] = traco;
+			}
+		}
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; nomes_roteadores[i][j] && cx[i] + j < DESENHO_LARGURA; j++)
+			tela[cy[i]][cx[i] + j] = nomes_roteadores[i][j];
+	
+	for(i=0; i<DESENHO_ALTURA; i++)
+		printf("         %s\n", tela[i]);
+	printf("\n");
+}
+
+int exporta_svg(const char * arquivo){
+	
+	/* A cor de cada enlace vai de verde (menos pacotes) a vermelho (mais
+	 * pacotes), somando os dois sentidos. */
+	
+	double x[N_ROTEADORES], y[N_ROTEADORES];
+	long carga, maximo = 1;
+	int i, j, vermelho;
+	FILE * f;
+	
+	f = fopen(arquivo, "w");
+	if(!f){
+		perror(arquivo);
+		return -1;
+	}
+	
+	calcula_layout(x, y);
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=i+1; j<N_ROTEADORES; j++)
+			if(pacotes_enlace[i][j] + pacotes_enlace[j][i] > maximo)
+				maximo = pacotes_enlace[i][j] + pacotes_enlace[j][i];
+	
+	fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"640\" height=\"640\" viewBox=\"-40 -40 680 680\">\n");
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=i+1; j<N_ROTEADORES; j++){
+			
+			if(!conectados(i, j)) continue;
+			
+			carga = pacotes_enlace[i][j] + pacotes_enlace[j][i];
+			vermelho = (int)(255 * carga / maximo);
+			
+			fprintf(f, "<line x1=\"%.1f\" y1=\"%.1f\" x2=\"%.1f\" y2=\"%.1f\" stroke=\"rgb(%d,%d,0)\" stroke-width=\"3\"><title>%s-%s: %ld pacotes</title></line>\n",
+				x[i]*600, y[i]*600, x[j]*600, y[j]*600, vermelho, 255 - vermelho,
+				nomes_roteadores[i], nomes_roteadores[j], carga);
+		}
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		fprintf(f, "<circle cx=\"%.1f\" cy=\"%.1f\" r=\"14\" fill=\"white\" stroke=\"black\"/><text x=\"%.1f\" y=\"%.1f\" text-anchor=\"middle\" dominant-baseline=\"central\">%s</text>\n",
+			x[i]*600, y[i]*600, x[i]*600, y[i]*600, nomes_roteadores[i]);
+	
+	fprintf(f, "</svg>\n");
+	fclose(f);
+	
+	return 0;
 }
 
 int envia_pacotes(roteador * r, int src){
@@ -354,15 +1681,20 @@ int envia_pacotes(roteador * r, int src){
 			// Define o remetente
 			pkt.remetente = src;
 			
-			// Copia as rotas pessoais para as rotas do pacote
-			int dst;
-			for( dst=0; dst<N_ROTEADORES; dst++){
-				pkt.rotas[dst].destino = r[src].rotas[dst].destino;
-				pkt.rotas[dst].caminho = r[src].rotas[dst].caminho;
-				pkt.rotas[dst].custo   = r[src].rotas[dst].custo;
+			// Copia as rotas pessoais (dos destinos simulados) para as rotas do pacote
+			int dst, k;
+			for( k=0; k<n_destinos; k++){
+				dst = destinos_amostrados[k];
+				pkt.rotas[k].destino = r[src].rotas[dst].destino;
+				pkt.rotas[k].caminho = r[src].rotas[dst].caminho;
+				pkt.rotas[k].custo   = r[src].rotas[dst].custo;
 			}
 	// ---------- Pacote finalizado -----------
 	
+	/* Na emulação o pacote é enviado de verdade, por UDP. */
+	if(emulacao_udp)
+		return envia_udp(&pkt, src);
+	
 	
 	
 	
@@ -371,60 +1703,52 @@ int envia_pacotes(roteador * r, int src){
 	/* O envio aqui é representado pela cópia do pacote no buffer de
 	 * entrada do roteador.
 	 * - "rota_dst" é o indexador da lista de rotas contidas no pacote
-	 * - "existe" é utilizada para informar se um destino na lista de
-	 * roteadores deve receber ou não o pacote. A verificação se baseia
-	 * na existência de um link físico entre os dispositivos (configurado
-	 * na matriz conexoes_enlaces). Esta variável é necessária para que
-	 * o simulador proteja dispositivos desconectados do remetente de
-	 * receberem uma mensagem impossível de ser recebida no mundo real.
-	 * - "dst_idx" é o indexador da lista de roteadores.
+	 * - "vizinho" percorre a lista de enlaces do remetente (configurada
+	 * na matriz conexoes_enlaces). Apenas os roteadores desta lista
+	 * recebem o pacote, o que protege dispositivos desconectados do
+	 * remetente de receberem uma mensagem impossível de ser recebida no
+	 * mundo real. Percorrer a lista direto evita testar cada roteador da
+	 * rede contra cada enlace do remetente.
 	 * - "pkt_drop" é a contagem de pacotes que não puderam ser entregues
 	 * aos roteadores. Este valor é retornado pela função e é somado à
 	 * variável de mesma função no laço principal. */
 	 
-	int rota_dst, existe, dst_idx, pkt_drop = 0;;
+	int rota_dst, vizinho, pkt_drop = 0;
 	
 	
 	// Envia o pacote para cada roteador ao alcance.
-	for (dst=0; dst<N_ROTEADORES; dst++){
-		
-		/* Aqui testamos se o roteados designado por dst existe na lista
-		 * de enlaces do roteador remetente. */
-		existe = 0;
-		for(dst_idx=0; dst_idx<N_ROTEADORES; dst_idx++)
-			if(conexoes_enlaces[src][dst_idx] == dst)
-				existe = 1;
-		
-		/* Se o roteador apontado por dst não existir na lista de
-		 * enlaces, significa que não é vizinho do remetente (src) e não
-		 * deve receber a mensagem. Este tipo de verificação, obviamente,
-		 * só é necessária pois estamos simulando a rede. Na prática,
-		 * os roteadores não-vizinhos não receberiam o pacote
-		 * simplesmente por não estarem conectados. */
-		if(existe){
-
-			// Testa se o buffer do destinatário está cheio.
-			if(r[dst].idx == (PKT_BUFFER))
-			{
-				pkt_drop++;
-			}
-			else
-			{
+	for (vizinho=0; vizinho<N_ROTEADORES; vizinho++){
+		
+		/* Posições com valor negativo não são enlaces. Este tipo de
+		 * verificação, obviamente, só é necessária pois estamos simulando
+		 * a rede. Na prática, os roteadores não-vizinhos não receberiam o
+		 * pacote simplesmente por não estarem conectados. */
+		dst = conexoes_enlaces[src][vizinho];
+		if(dst < 0) continue;
 
-				// Insere o remetende no buffer do destinatário.
-				r[dst].entrada[r[dst].idx].remetente = pkt.remetente;
-				
-				// Copia todas as rotas do pacote para o buffer do destinatário.
-				for(rota_dst = 0; rota_dst<N_ROTEADORES; rota_dst++){
-					
-					r[dst].entrada[r[dst].idx].rotas[rota_dst].destino = pkt.rotas[rota_dst].destino;
-					r[dst].entrada[r[dst].idx].rotas[rota_dst].caminho = pkt.rotas[rota_dst].caminho;
-					r[dst].entrada[r[dst].idx].rotas[rota_dst].custo   = pkt.rotas[rota_dst].custo;
+		// Testa se o buffer do destinatário está cheio.
+		if(r[dst].idx == (PKT_BUFFER))
+		{
+			pkt_drop++;
+		}
+		else
+		{
 
-				}
-				r[dst].idx++;
+			// Insere o remetende no buffer do destinatário.
+			r[dst].entrada[r[dst].idx].remetente = pkt.remetente;
+			
+			// Copia todas as rotas do pacote para o buffer do destinatário.
+			for(rota_dst = 0; rota_dst<n_destinos; rota_dst++){
 				
+				r[dst].entrada[r[dst].idx].rotas[rota_dst].destino = pkt.rotas[rota_dst].destino;
+				r[dst].entrada[r[dst].idx].rotas[rota_dst].caminho = pkt.rotas[rota_dst].caminho;
+				r[dst].entrada[r[dst].idx].rotas[rota_dst].custo   = pkt.rotas[rota_dst].custo;
+
 			}
+			r[dst].idx++;
+			pacotes_enviados++;
+			pacotes_enlace[src][dst]++;
+			
 		}
 	}
 	// --------- Envio finalizado ---------
@@ -468,15 +1792,7 @@ void preencher_enlaces(roteador * roteadores){
 	
 	printf("\n\tDICA: Para auto-preencher o resto da tabela com custo 1,\n\t      insira custo zero a qualquer momento.\n\n");
 	
-	// Define custo infinito para tudo e zera idx
-	for(i=0; i<N_ROTEADORES; i++){
-		
-		roteadores[i].idx = 0;
-		
-		for(j=0; j<N_ROTEADORES; j++){
-			_preencher_enlaces(roteadores, i, j, INFINITO);
-		}
-	}
+	inicia_tabelas(roteadores);
 	
 	for(i=0; i<N_ROTEADORES; i++){
 		for(j=0; j<N_ROTEADORES; j++){
@@ -497,23 +1813,3920 @@ void preencher_enlaces(roteador * roteadores){
 					printf("%d\n", custo);
 
 				_preencher_enlaces(roteadores, i, conexoes_enlaces[i][j], custo);
+				custos_enlaces[i][conexoes_enlaces[i][j]] = custo;
 			}
 		}
 	}
 	printf("\n%d custos definidos.\n%d enlaces presentes.\n\n", conta, conta/2);
 }
 
-void _preencher_enlaces(roteador * r, int src, int dst, int custo){
+/* Arquivo que guarda as tabelas, quando aloca_roteadores() recebe um. */
+static int tabelas_mapeadas = 0;
+
+roteador * aloca_roteadores(const char * arquivo){
 	
-	/* Preenche a rota destinada àquele roteador (rotas[dst]) com o
-	 * destino, caminho (o próprio destino neste caso) e o custo. */
-	 
-	r[src].rotas[dst].destino = dst;
+	/* No modo mapeado o arquivo é criado (ou truncado) com o tamanho exato
+	 * do vetor de roteadores, e o sistema decide quais páginas ficam na
+	 * memória. Como recebe_pacote() percorre os roteadores em ordem, o
+	 * acesso é sequencial e o sistema é avisado disso, e também de que
+	 * todo o vetor será usado logo. Os avisos são dados uma única vez:
+	 * repeti-los a cada roteador e passo custava uma chamada de sistema
+	 * por roteador sem trazer nada que a leitura antecipada já não traga. */
 	
-	if(custo==INFINITO)
-		r[src].rotas[dst].caminho = -1;
+	roteador * r;
+	size_t tamanho = N_ROTEADORES * sizeof(roteador);
+	int fd;
+	
+	if(!arquivo){
+		r = calloc(N_ROTEADORES, sizeof(roteador));
+		if(!r) perror("calloc");
+		return r;
+	}
+	
+	fd = open(arquivo, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || ftruncate(fd, tamanho) < 0){
+		perror(arquivo);
+		if(fd >= 0) close(fd);
+		return NULL;
+	}
+	
+	r = mmap(NULL, tamanho, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(r == MAP_FAILED){
+		perror(arquivo);
+		return NULL;
+	}
+	
+	madvise(r, tamanho, MADV_SEQUENTIAL);
+	madvise(r, tamanho, MADV_WILLNEED);
+	tabelas_mapeadas = 1;
+	
+	return r;
+}
+
+void libera_roteadores(roteador * r){
+	
+	if(tabelas_mapeadas)
+		munmap(r, N_ROTEADORES * sizeof(roteador));
 	else
-		r[src].rotas[dst].caminho = dst;
+		free(r);
+}
 
-	r[src].rotas[dst].custo = custo;
+void inicia_tabelas(roteador * roteadores){
+	
+	int i, j;
+	
+	// Define custo infinito para tudo e zera idx
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		roteadores[i].idx = 0;
+		
+		for(j=0; j<N_ROTEADORES; j++){
+			_preencher_enlaces(roteadores, i, j, INFINITO);
+			custos_enlaces[i][j] = ORACULO_INF;
+			ultima_mudanca[i][j] = -1;
+		}
+	}
+}
+
+/* Lê um varint sem passar de "fim" e avança o ponteiro. */
+static uint32_t le_varint(const uint8_t ** p, const uint8_t * fim){
+	
+	uint32_t valor = 0;
+	int deslocamento = 0;
+	
+	while(*p < fim && deslocamento < 32){
+		valor |= (uint32_t)(**p & 0x7f) << deslocamento;
+		if(!(*(*p)++ & 0x80)) break;
+		deslocamento += 7;
+	}
+	
+	return valor;
+}
+
+/* Escreve um varint em "p" e retorna a posição seguinte. */
+static uint8_t * escreve_varint(uint8_t * p, uint32_t valor){
+	
+	while(valor >= 0x80){
+		*p++ = (valor & 0x7f) | 0x80;
+		valor >>= 7;
+	}
+	*p++ = valor;
+	
+	return p;
+}
+
+/* Libera o mapeamento e informa o erro de carrega_topologia(). */
+static int topologia_invalida(const char * arquivo, const char * base, size_t tamanho, const char * motivo, int roteador){
+	
+	if(roteador >= 0)
+		fprintf(stderr, "%s: %s (roteador %d)\n", arquivo, motivo, roteador);
+	else
+		fprintf(stderr, "%s: %s\n", arquivo, motivo);
+	munmap((void *) base, tamanho);
+	
+	return -1;
+}
+
+int carrega_topologia(roteador * roteadores, const char * arquivo){
+	
+	/* O arquivo é mapeado somente para leitura e nunca é desmapeado: os
+	 * nomes dos roteadores apontam diretamente para a tabela de texto
+	 * dentro dele. Vários processos carregando o mesmo arquivo dividem
+	 * as mesmas páginas do cache do sistema. A quantidade de roteadores
+	 * precisa ser igual a N_ROTEADORES, que é fixa em tempo de compilação.
+	 * 
+	 * O arquivo pode vir de qualquer lugar, então tudo é conferido antes
+	 * de ser usado: as seções precisam estar alinhadas e dentro do
+	 * arquivo, os deslocamentos não podem diminuir, os vizinhos precisam
+	 * existir e não se repetir, os nomes precisam terminar dentro da tabela
+	 * de texto e os custos precisam estar entre 1 e INFINITO-1. Os campos são convertidos
+	 * de little-endian (le32toh não custa nada em máquinas little-endian). */
+	
+	const topologia_binaria_t * cab;
+	const uint32_t * deslocamentos;
+	const uint8_t * vizinhos, * p, * fim;
+	const int32_t * custos;
+	const uint32_t * nomes;
+	const char * base;
+	struct stat info;
+	uint32_t versao, n_roteadores, n_enlaces, tamanho;
+	uint32_t pos_deslocamentos, pos_vizinhos, pos_custos, pos_nomes;
+	uint32_t e = 0, v, nome, anterior;
+	size_t unidade;
+	int32_t custo;
+	int fd, i, j, k;
+	
+	fd = open(arquivo, O_RDONLY);
+	if(fd < 0 || fstat(fd, &info) < 0){
+		perror(arquivo);
+		return -1;
+	}
+	
+	if((size_t)info.st_size < sizeof(topologia_binaria_t)){
+		fprintf(stderr, "%s: arquivo de topologia truncado\n", arquivo);
+		close(fd);
+		return -1;
+	}
+	
+	base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED){
+		perror(arquivo);
+		return -1;
+	}
+	
+	cab = (const topologia_binaria_t *) base;
+	versao            = le32toh(cab->versao);
+	n_roteadores      = le32toh(cab->n_roteadores);
+	n_enlaces         = le32toh(cab->n_enlaces);
+	pos_deslocamentos = le32toh(cab->pos_deslocamentos);
+	pos_vizinhos      = le32toh(cab->pos_vizinhos);
+	pos_custos        = le32toh(cab->pos_custos);
+	pos_nomes         = le32toh(cab->pos_nomes);
+	tamanho           = le32toh(cab->tamanho);
+	
+	if(memcmp(cab->magica, TOPOLOGIA_MAGICA, 4) || versao < 1 || versao > TOPOLOGIA_VERSAO || tamanho != info.st_size)
+		return topologia_invalida(arquivo, base, info.st_size, "não é um arquivo de topologia válido", -1);
+	
+	if(n_roteadores != N_ROTEADORES){
+		fprintf(stderr, "%s: a topologia tem %u roteadores, mas o simulador foi compilado para %d\n", arquivo, n_roteadores, N_ROTEADORES);
+		munmap((void *) base, info.st_size);
+		return -1;
+	}
+	
+	/* Na versão 1 os deslocamentos contam enlaces de 4 bytes; na 2, bytes.
+	 * As contas são feitas em 64 bits para que nenhuma posição dê a volta. */
+	unidade = versao == 1 ? sizeof(uint32_t) : 1;
+	
+	if(pos_deslocamentos % 8 || pos_vizinhos % 8 || pos_custos % 8 || pos_nomes % 8 ||
+	   (uint64_t) pos_deslocamentos + (N_ROTEADORES + 1) * sizeof(uint32_t) > tamanho ||
+	   (uint64_t) pos_custos + (uint64_t) n_enlaces * sizeof(int32_t) > tamanho ||
+	   (uint64_t) pos_nomes + (N_ROTEADORES + 1) * sizeof(uint32_t) > tamanho)
+		return topologia_invalida(arquivo, base, info.st_size, "seções do arquivo de topologia inconsistentes", -1);
+	
+	deslocamentos = (const uint32_t *)(base + pos_deslocamentos);
+	vizinhos      = (const uint8_t *)  (base + pos_vizinhos);
+	custos        = (const int32_t *) (base + pos_custos);
+	nomes         = (const uint32_t *)(base + pos_nomes);
+	
+	for(i=0, anterior=0; i<=N_ROTEADORES; i++){
+		if(le32toh(deslocamentos[i]) < anterior)
+			return topologia_invalida(arquivo, base, info.st_size, "deslocamentos fora de ordem", i);
+		anterior = le32toh(deslocamentos[i]);
+	}
+	
+	if((uint64_t) pos_vizinhos + anterior * unidade > tamanho)
+		return topologia_invalida(arquivo, base, info.st_size, "lista de vizinhos além do fim do arquivo", -1);
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		nome = le32toh(nomes[i]);
+		if((uint64_t) pos_nomes + nome >= tamanho || !memchr(base + pos_nomes + nome, '\0', tamanho - pos_nomes - nome))
+			return topologia_invalida(arquivo, base, info.st_size, "nome fora da tabela de texto", i);
+	}
+	
+	inicia_tabelas(roteadores);
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		nomes_roteadores[i] = (char *)(base + pos_nomes + le32toh(nomes[i]));
+		
+		for(j=0; j<N_ROTEADORES; j++)
+			conexoes_enlaces[i][j] = -1;
+		
+		p   = vizinhos + le32toh(deslocamentos[i])   * unidade;
+		fim = vizinhos + le32toh(deslocamentos[i+1]) * unidade;
+		
+		/* Os vizinhos são decodificados direto do mapeamento. O contador
+		 * "e" avança pelos custos, que são guardados na mesma ordem. Um
+		 * vizinho repetido (na versão 2, uma diferença 0) faria o roteador
+		 * enviar cada pacote duas vezes ao mesmo vizinho. */
+		for(j=0, v=0; p < fim; j++, e++){
+			
+			if(versao == 1){
+				memcpy(&v, p, sizeof(uint32_t));
+				v = le32toh(v);
+				p += sizeof(uint32_t);
+			}else
+				v += le_varint(&p, fim);
+			
+			if(v >= N_ROTEADORES || e >= n_enlaces || j >= N_ROTEADORES)
+				return topologia_invalida(arquivo, base, info.st_size, "lista de vizinhos inválida", i);
+			
+			for(k=0; k<j; k++)
+				if(conexoes_enlaces[i][k] == (int) v)
+					return topologia_invalida(arquivo, base, info.st_size, "enlace repetido", i);
+			
+			custo = (int32_t) le32toh((uint32_t) custos[e]);
+			if(custo < 1 || custo >= INFINITO)
+				return topologia_invalida(arquivo, base, info.st_size, "custo de enlace fora de 1..INFINITO-1", i);
+			
+			conexoes_enlaces[i][j] = v;
+			_preencher_enlaces(roteadores, i, v, custo);
+			custos_enlaces[i][v] = custo;
+		}
+	}
+	
+	printf("Topologia carregada de %s: %u roteadores, %u enlaces.\n\n", arquivo, n_roteadores, n_enlaces);
+	
+	return 0;
+}
+
+/* Procura um nome na lista, acrescentando-o se ainda não existir.
+ * Retorna o ID correspondente. */
+static int id_do_nome(char *** nomes, int * n, const char * nome){
+	
+	int i;
+	
+	for(i=0; i<*n; i++)
+		if(!strcmp((*nomes)[i], nome))
+			return i;
+	
+	*nomes = realloc(*nomes, (*n + 1) * sizeof(char *));
+	(*nomes)[*n] = strdup(nome);
+	
+	return (*n)++;
+}
+
+/* Arredonda para o próximo múltiplo de 8. */
+#define ALINHA(x) (((x) + 7) & ~7u)
+
+int converte_topologia(const char * entrada, const char * saida){
+	
+	/* A lista em texto tem um enlace por linha, no formato
+	 * "origem destino custo". Linhas vazias ou começando por '#' são
+	 * ignoradas. Cada linha define um único sentido do enlace, assim como
+	 * na inserção manual de custos, e não pode se repetir. Os IDs são
+	 * atribuídos na ordem em que os nomes aparecem. */
+	
+	FILE * fe, * fs;
+	char linha[256], origem[64], destino[64];
+	char ** nomes = NULL;
+	int n = 0, m = 0, custo, i, e, num_linha = 0;
+	int * enlace_origem = NULL, * enlace_destino = NULL, * enlace_custo = NULL;
+	
+	topologia_binaria_t cab;
+	uint32_t * deslocamentos, * vizinhos, * pos_nomes;
+	int32_t * custos;
+	uint32_t tamanho_nomes = 0;
+	uint8_t * compactos, * q;
+	char * zeros;
+	
+	fe = fopen(entrada, "r");
+	if(!fe){
+		perror(entrada);
+		return -1;
+	}
+	
+	while(fgets(linha, sizeof(linha), fe)){
+		
+		num_linha++;
+		if(linha[0] == '#' || sscanf(linha, "%63s %63s %d", origem, destino, &custo) != 3)
+			continue;
+		
+		if(custo < 1 || custo >= INFINITO){
+			fprintf(stderr, "%s:%d: custo %d fora de 1..%d\n", entrada, num_linha, custo, INFINITO - 1);
+			fclose(fe);
+			return -1;
+		}
+		
+		enlace_origem  = realloc(enlace_origem,  (m+1) * sizeof(int));
+		enlace_destino = realloc(enlace_destino, (m+1) * sizeof(int));
+		enlace_custo   = realloc(enlace_custo,   (m+1) * sizeof(int));
+		
+		enlace_origem[m]  = id_do_nome(&nomes, &n, origem);
+		enlace_destino[m] = id_do_nome(&nomes, &n, destino);
+		enlace_custo[m]   = custo;
+		m++;
+	}
+	fclose(fe);
+	
+	// Monta o CSR agrupando os enlaces pela origem
+	deslocamentos = calloc(n + 1, sizeof(uint32_t));
+	vizinhos      = malloc(m * sizeof(uint32_t) + 1);
+	custos        = malloc(m * sizeof(int32_t) + 1);
+	pos_nomes     = malloc((n + 1) * sizeof(uint32_t));
+	
+	for(e=0; e<m; e++)
+		deslocamentos[enlace_origem[e] + 1]++;
+	for(i=0; i<n; i++)
+		deslocamentos[i+1] += deslocamentos[i];
+	
+	{
+		uint32_t * proximo = malloc((n + 1) * sizeof(uint32_t));
+		memcpy(proximo, deslocamentos, (n + 1) * sizeof(uint32_t));
+		for(e=0; e<m; e++){
+			vizinhos[proximo[enlace_origem[e]]] = enlace_destino[e];
+			custos[proximo[enlace_origem[e]]++] = enlace_custo[e];
+		}
+		free(proximo);
+	}
+	
+	/* Ordena os vizinhos de cada roteador (levando junto os custos) e os
+	 * codifica como diferenças em varints. No pior caso cada varint de 32
+	 * bits ocupa 5 bytes. Os deslocamentos passam a contar bytes. */
+	compactos = malloc(m * 5 + 1);
+	q = compactos;
+	
+	for(i=0; i<n; i++){
+		
+		uint32_t a, b, anterior = 0, tv;
+		int32_t tc;
+		
+		for(a=deslocamentos[i]+1; a<deslocamentos[i+1]; a++)
+			for(b=a; b>deslocamentos[i] && vizinhos[b-1] > vizinhos[b]; b--){
+				tv = vizinhos[b]; vizinhos[b] = vizinhos[b-1]; vizinhos[b-1] = tv;
+				tc = custos[b];   custos[b]   = custos[b-1];   custos[b-1]   = tc;
+			}
+		
+		/* Depois de ordenados, enlaces repetidos ficam lado a lado. */
+		for(a=deslocamentos[i]+1; a<deslocamentos[i+1]; a++)
+			if(vizinhos[a] == vizinhos[a-1]){
+				fprintf(stderr, "%s: enlace %s %s repetido\n", entrada, nomes[i], nomes[vizinhos[a]]);
+				return -1;
+			}
+		
+		a = deslocamentos[i];
+		deslocamentos[i] = q - compactos;
+		for(; a<deslocamentos[i+1]; a++){
+			q = escreve_varint(q, vizinhos[a] - anterior);
+			anterior = vizinhos[a];
+		}
+	}
+	deslocamentos[n] = q - compactos;
+	
+	for(i=0; i<n; i++){
+		pos_nomes[i] = (n + 1) * sizeof(uint32_t) + tamanho_nomes;
+		tamanho_nomes += strlen(nomes[i]) + 1;
+	}
+	pos_nomes[n] = (n + 1) * sizeof(uint32_t) + tamanho_nomes;
+	
+	memset(&cab, 0, sizeof(cab));
+	memcpy(cab.magica, TOPOLOGIA_MAGICA, 4);
+	cab.versao            = TOPOLOGIA_VERSAO;
+	cab.n_roteadores      = n;
+	cab.n_enlaces         = m;
+	cab.pos_deslocamentos = ALINHA(sizeof(cab));
+	cab.pos_vizinhos      = ALINHA(cab.pos_deslocamentos + (n + 1) * sizeof(uint32_t));
+	cab.pos_custos        = ALINHA(cab.pos_vizinhos + deslocamentos[n]);
+	cab.pos_nomes         = ALINHA(cab.pos_custos + m * sizeof(int32_t));
+	cab.tamanho           = ALINHA(cab.pos_nomes + pos_nomes[n]);
+	
+	fs = fopen(saida, "wb");
+	if(!fs){
+		perror(saida);
+		return -1;
+	}
+	
+	/* Cada seção é escrita na sua posição, preenchendo o alinhamento com
+	 * zeros. As posições são guardadas antes da conversão para
+	 * little-endian, que é feita no próprio lugar. */
+	{
+		topologia_binaria_t posicoes = cab;
+		uint32_t tamanho_compactos = deslocamentos[n];
+		
+		cab.versao            = htole32(cab.versao);
+		cab.n_roteadores      = htole32(cab.n_roteadores);
+		cab.n_enlaces         = htole32(cab.n_enlaces);
+		cab.pos_deslocamentos = htole32(cab.pos_deslocamentos);
+		cab.pos_vizinhos      = htole32(cab.pos_vizinhos);
+		cab.pos_custos        = htole32(cab.pos_custos);
+		cab.pos_nomes         = htole32(cab.pos_nomes);
+		cab.tamanho           = htole32(cab.tamanho);
+		for(i=0; i<=n; i++){
+			deslocamentos[i] = htole32(deslocamentos[i]);
+			pos_nomes[i]     = htole32(pos_nomes[i]);
+		}
+		for(e=0; e<m; e++)
+			custos[e] = (int32_t) htole32((uint32_t) custos[e]);
+		
+		zeros = calloc(1, posicoes.tamanho);
+		fwrite(zeros, 1, posicoes.tamanho, fs);
+		fseek(fs, 0, SEEK_SET);
+		fwrite(&cab, sizeof(cab), 1, fs);
+		fseek(fs, posicoes.pos_deslocamentos, SEEK_SET);
+		fwrite(deslocamentos, sizeof(uint32_t), n + 1, fs);
+		fseek(fs, posicoes.pos_vizinhos, SEEK_SET);
+		fwrite(compactos, 1, tamanho_compactos, fs);
+		fseek(fs, posicoes.pos_custos, SEEK_SET);
+		fwrite(custos, sizeof(int32_t), m, fs);
+		fseek(fs, posicoes.pos_nomes, SEEK_SET);
+		fwrite(pos_nomes, sizeof(uint32_t), n + 1, fs);
+		for(i=0; i<n; i++)
+			fwrite(nomes[i], 1, strlen(nomes[i]) + 1, fs);
+	}
+	fclose(fs);
+	
+	printf("%s: %d roteadores, %d enlaces.\n", saida, n, m);
+	
+	for(i=0; i<n; i++)
+		free(nomes[i]);
+	free(nomes);
+	free(zeros);
+	free(enlace_origem);
+	free(enlace_destino);
+	free(enlace_custo);
+	free(deslocamentos);
+	free(vizinhos);
+	free(compactos);
+	free(custos);
+	free(pos_nomes);
+	
+	return 0;
+}
+
+void _preencher_enlaces(roteador * r, int src, int dst, int custo){
+	
+	/* Preenche a rota destinada àquele roteador (rotas[dst]) com o
+	 * destino, caminho (o próprio destino neste caso) e o custo. */
+	 
+	r[src].rotas[dst].destino = dst;
+	
+	if(custo==INFINITO)
+		r[src].rotas[dst].caminho = -1;
+	else
+		r[src].rotas[dst].caminho = dst;
+
+	r[src].rotas[dst].custo = custo;
+}
+
+void oraculo_inicializa(void){
+	
+	/* Para cada destino, executa um Dijkstra sobre os enlaces invertidos:
+	 * parte do destino e descobre o menor custo de cada roteador até ele.
+	 * Com poucos roteadores a versão com vetores (sem heap) é suficiente. */
+	
+	int finalizado[N_ROTEADORES];
+	int destino, i, x, w;
+	
+	for(destino=0; destino<N_ROTEADORES; destino++){
+		
+		for(i=0; i<N_ROTEADORES; i++){
+			distancias_referencia[i][destino] = ORACULO_INF;
+			finalizado[i] = 0;
+		}
+		distancias_referencia[destino][destino] = 0;
+		
+		while(1){
+			
+			// Escolhe o roteador não finalizado mais próximo do destino
+			x = -1;
+			for(i=0; i<N_ROTEADORES; i++)
+				if(!finalizado[i] && distancias_referencia[i][destino] != ORACULO_INF)
+					if(x == -1 || distancias_referencia[i][destino] < distancias_referencia[x][destino])
+						x = i;
+			
+			if(x == -1) break;
+			finalizado[x] = 1;
+			
+			// Relaxa os enlaces que chegam em x (w -> x)
+			for(w=0; w<N_ROTEADORES; w++)
+				if(!finalizado[w] && custos_enlaces[w][x] != ORACULO_INF)
+					if(custos_enlaces[w][x] + distancias_referencia[x][destino] < distancias_referencia[w][destino])
+						distancias_referencia[w][destino] = custos_enlaces[w][x] + distancias_referencia[x][destino];
+		}
+	}
+}
+
+/* Retorna 1 se o enlace v -> x faz parte de um caminho mínimo de v até o
+ * destino, isto é, se o custo do enlace somado à distância de x é igual à
+ * distância de v. */
+static int oraculo_enlace_justo(int v, int x, int destino){
+	
+	if(custos_enlaces[v][x] == ORACULO_INF || distancias_referencia[x][destino] == ORACULO_INF)
+		return 0;
+	
+	return custos_enlaces[v][x] + distancias_referencia[x][destino] == distancias_referencia[v][destino];
+}
+
+/* Retorna 1 se v possui algum enlace justo para um roteador não afetado,
+ * ou seja, se sua distância atual continua válida. */
+static int oraculo_possui_apoio(int v, int destino, int * afetado){
+	
+	int x;
+	for(x=0; x<N_ROTEADORES; x++)
+		if(!afetado[x] && oraculo_enlace_justo(v, x, destino))
+			return 1;
+	
+	return 0;
+}
+
+int oraculo_altera_enlace(int src, int dst, int custo){
+	
+	/* Atualização incremental no estilo Ramalingam-Reps. Cada destino é
+	 * tratado separadamente e apenas os roteadores cuja distância muda
+	 * são visitados:
+	 * 
+	 * - Se o enlace ficou mais barato, a melhora é propagada a partir de
+	 * src como em um Dijkstra que começa já com as distâncias antigas.
+	 * 
+	 * - Se o enlace ficou mais caro, primeiro descobrimos o conjunto de
+	 * roteadores afetados (os que perderam todos os seus caminhos mínimos)
+	 * e depois recalculamos as distâncias apenas dentro deste conjunto,
+	 * partindo da fronteira com os roteadores não afetados.
+	 * 
+	 * O valor ORACULO_INF remove o enlace. */
+	
+	int afetado[N_ROTEADORES];		// roteadores que perderam o caminho mínimo
+	int na_fila[N_ROTEADORES];		// roteadores cuja distância ainda será propagada
+	int pilha[N_ROTEADORES];		// lista de trabalho da busca de afetados
+	int topo;
+	
+	int custo_antigo = custos_enlaces[src][dst];
+	int mudancas = 0;
+	int destino, i, x, w, d;
+	
+	custos_enlaces[src][dst] = custo;
+	
+	if(custo == custo_antigo)
+		return 0;
+	
+	for(destino=0; destino<N_ROTEADORES; destino++){
+		
+		for(i=0; i<N_ROTEADORES; i++){
+			afetado[i] = 0;
+			na_fila[i] = 0;
+		}
+		
+		if(custo < custo_antigo){
+			
+			// ------ Enlace mais barato ------
+			if(distancias_referencia[dst][destino] == ORACULO_INF)
+				continue;
+			if(custo + distancias_referencia[dst][destino] >= distancias_referencia[src][destino])
+				continue;
+			
+			distancias_referencia[src][destino] = custo + distancias_referencia[dst][destino];
+			na_fila[src] = 1;
+			mudancas++;
+			
+		}else{
+			
+			// ------ Enlace mais caro ------
+			/* Se o enlace não era justo, nenhum caminho mínimo passava por ele. */
+			if(custo_antigo == ORACULO_INF || distancias_referencia[dst][destino] == ORACULO_INF)
+				continue;
+			if(custo_antigo + distancias_referencia[dst][destino] != distancias_referencia[src][destino])
+				continue;
+			if(src == destino || oraculo_possui_apoio(src, destino, afetado))
+				continue;
+			
+			afetado[src] = 1;
+			pilha[0] = src;
+			topo = 1;
+			
+			/* Um roteador w que chegava ao destino por x se torna afetado
+			 * quando x é afetado e w não tem outro caminho mínimo. */
+			while(topo){
+				x = pilha[--topo];
+				for(w=0; w<N_ROTEADORES; w++)
+					if(!afetado[w] && w != destino && oraculo_enlace_justo(w, x, destino))
+						if(!oraculo_possui_apoio(w, destino, afetado)){
+							afetado[w] = 1;
+							pilha[topo++] = w;
+						}
+			}
+			
+			// Distância provisória de cada afetado pela fronteira não afetada
+			for(w=0; w<N_ROTEADORES; w++){
+				if(!afetado[w]) continue;
+				
+				d = ORACULO_INF;
+				for(x=0; x<N_ROTEADORES; x++)
+					if(!afetado[x] && custos_enlaces[w][x] != ORACULO_INF && distancias_referencia[x][destino] != ORACULO_INF)
+						if(custos_enlaces[w][x] + distancias_referencia[x][destino] < d)
+							d = custos_enlaces[w][x] + distancias_referencia[x][destino];
+				
+				distancias_referencia[w][destino] = d;
+				na_fila[w] = 1;
+				mudancas++;
+			}
+		}
+		
+		/* Propagação comum aos dois casos: Dijkstra restrito aos roteadores
+		 * presentes na fila. Cada roteador retirado tem distância final e
+		 * relaxa os enlaces que chegam nele. */
+		while(1){
+			
+			x = -1;
+			for(i=0; i<N_ROTEADORES; i++)
+				if(na_fila[i] && (x == -1 || distancias_referencia[i][destino] < distancias_referencia[x][destino]))
+					x = i;
+			
+			if(x == -1 || distancias_referencia[x][destino] == ORACULO_INF) break;
+			na_fila[x] = 0;
+			
+			for(w=0; w<N_ROTEADORES; w++)
+				if(custos_enlaces[w][x] != ORACULO_INF)
+					if(custos_enlaces[w][x] + distancias_referencia[x][destino] < distancias_referencia[w][destino]){
+						
+						/* Na piora, roteadores afetados já foram contados. */
+						if(!afetado[w]) mudancas++;
+						
+						distancias_referencia[w][destino] = custos_enlaces[w][x] + distancias_referencia[x][destino];
+						na_fila[w] = 1;
+					}
+		}
+	}
+	
+	return mudancas;
+}
+
+int verifica_rotas(roteador * r){
+	
+	/* Uma rota confere com a referência quando tem o mesmo custo. Distâncias
+	 * iguais ou maiores que INFINITO não podem ser aprendidas pelo algoritmo,
+	 * então nestes casos basta que a rota também seja considerada inacessível.
+	 * A rota de um roteador até si mesmo não é verificada (nem impressa). */
+	
+	int i, j, k;
+	int divergencias = 0;
+	
+	/* Apenas os destinos simulados são verificados. */
+	for(i=0; i<N_ROTEADORES; i++)
+		for(k=0; k<n_destinos; k++){
+			
+			j = destinos_amostrados[k];
+			if(i==j) continue;
+			
+			if(distancias_referencia[i][j] >= INFINITO){
+				if(r[i].rotas[j].custo >= INFINITO) continue;
+			}else if(r[i].rotas[j].custo == distancias_referencia[i][j]) continue;
+			
+			if(distancias_referencia[i][j] >= INFINITO)
+				printf("Divergência: C(%s,%s)=%d, esperado INF\n", nomes_roteadores[i], nomes_roteadores[j], r[i].rotas[j].custo);
+			else
+				printf("Divergência: C(%s,%s)=%d, esperado %d\n", nomes_roteadores[i], nomes_roteadores[j], r[i].rotas[j].custo, distancias_referencia[i][j]);
+			
+			divergencias++;
+		}
+	
+	return divergencias;
+}
+
+/* Estado compartilhado entre a thread principal e as auxiliares.
+ * 
+ * A simulação avança em janelas de um passo: todos os pacotes enviados
+ * em um passo são consumidos no mesmo passo, e nenhum pacote atravessa
+ * um enlace em menos de um passo (esta é a antecipação disponível). Por
+ * isso a fase de envio é sequencial e a de recebimento pode ser paralela:
+ * recebe_pacote() só lê e escreve no próprio roteador de destino. As duas
+ * barreiras delimitam a janela, e o resultado é idêntico ao sequencial. */
+
+typedef struct trabalhador_t{
+	
+	/* id: índice da thread (0 é a thread principal)
+	 * delta: mudanças nas tabelas feitas pela thread no passo atual
+	 * ocupado: tempo acumulado processando pacotes, em segundos */
+	
+	int id;
+	int delta;
+	double ocupado;
+	pthread_t thread;
+}trabalhador_t;
+
+static trabalhador_t trabalhadores[N_THREADS];
+static pthread_barrier_t barreira_inicio, barreira_fim;
+static roteador * roteadores_compartilhados;
+static int encerrar_threads = 0;
+static double tempo_recebimento = 0;	// tempo de parede da fase de recebimento
+static int threads_em_uso = 1;			// threads usadas no passo atual
+
+double relogio(void){
+	
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+/* Processa o bloco contíguo de roteadores que pertence à thread. */
+static void recebe_bloco(trabalhador_t * t){
+	
+	int inicio = t->id * N_ROTEADORES / threads_em_uso;
+	int fim = (t->id + 1) * N_ROTEADORES / threads_em_uso;
+	int r_idx, d;
+	double t0 = relogio();
+	
+	t->delta = 0;
+	for(r_idx = inicio; r_idx < fim; r_idx++){
+		d = recebe_pacote(roteadores_compartilhados, r_idx);
+		alterado_no_recebimento[r_idx] = (d != 0);
+		if(d) roteador_alterado[r_idx] = 1;
+		t->delta += d;
+	}
+	
+	t->ocupado += relogio() - t0;
+}
+
+static void * laco_trabalhador(void * arg){
+	
+	trabalhador_t * t = arg;
+	
+	while(1){
+		pthread_barrier_wait(&barreira_inicio);
+		if(encerrar_threads) break;
+		recebe_bloco(t);
+		pthread_barrier_wait(&barreira_fim);
+	}
+	
+	return NULL;
+}
+
+void inicia_threads(void){
+	
+	int i;
+	
+	if(n_threads < 1) n_threads = 1;
+	if(n_threads > N_THREADS) n_threads = N_THREADS;
+	
+	for(i=0; i<n_threads; i++){
+		trabalhadores[i].id = i;
+		trabalhadores[i].ocupado = 0;
+	}
+	
+	threads_em_uso = n_threads;
+	
+	if(n_threads == 1) return;
+	
+	pthread_barrier_init(&barreira_inicio, NULL, n_threads);
+	pthread_barrier_init(&barreira_fim, NULL, n_threads);
+	
+	// A thread principal faz o papel do trabalhador 0
+	for(i=1; i<n_threads; i++)
+		pthread_create(&trabalhadores[i].thread, NULL, laco_trabalhador, &trabalhadores[i]);
+}
+
+int recebe_pacotes_paralelo(roteador * r){
+	
+	int i, delta = 0;
+	double t0 = relogio();
+	
+	roteadores_compartilhados = r;
+	
+	if(threads_em_uso == 1){
+		recebe_bloco(&trabalhadores[0]);
+	}else{
+		pthread_barrier_wait(&barreira_inicio);
+		recebe_bloco(&trabalhadores[0]);
+		pthread_barrier_wait(&barreira_fim);
+	}
+	
+	for(i=0; i<threads_em_uso; i++)
+		delta += trabalhadores[i].delta;
+	
+	tempo_recebimento += relogio() - t0;
+	
+	return delta;
+}
+
+void finaliza_threads(void){
+	
+	/* A eficiência é o tempo útil somado de todas as threads dividido
+	 * pelo tempo que elas estiveram disponíveis (parede x threads). */
+	
+	int i;
+	double ocupado = 0;
+	
+	if(n_threads == 1) return;
+	
+	threads_em_uso = n_threads;
+	encerrar_threads = 1;
+	pthread_barrier_wait(&barreira_inicio);
+	
+	for(i=1; i<n_threads; i++)
+		pthread_join(trabalhadores[i].thread, NULL);
+	
+	pthread_barrier_destroy(&barreira_inicio);
+	pthread_barrier_destroy(&barreira_fim);
+	
+	for(i=0; i<n_threads; i++)
+		ocupado += trabalhadores[i].ocupado;
+	
+	if(tempo_recebimento > 0)
+		printf("Eficiência paralela (%d threads): %.1f%%\n", n_threads, 100.0 * ocupado / (tempo_recebimento * n_threads));
+	
+	encerrar_threads = 0;
+}
+
+void seleciona_motor(int paralelo){
+	
+	threads_em_uso = paralelo ? n_threads : 1;
+}
+
+void sorteia_destinos(int amostra){
+	
+	/* Embaralhamento de Fisher-Yates parcial: as primeiras "amostra"
+	 * posições ficam com destinos distintos sorteados, que depois são
+	 * ordenados para manter o acesso às tabelas em ordem crescente.
+	 * Amostra zero simula todos os destinos. */
+	
+	int i, j, t;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		destinos_amostrados[i] = i;
+	
+	if(amostra == 0 || amostra == N_ROTEADORES){
+		n_destinos = N_ROTEADORES;
+		return;
+	}
+	
+	for(i=0; i<amostra; i++){
+		j = i + random() % (N_ROTEADORES - i);
+		t = destinos_amostrados[i]; destinos_amostrados[i] = destinos_amostrados[j]; destinos_amostrados[j] = t;
+	}
+	
+	for(i=1; i<amostra; i++)
+		for(j=i; j>0 && destinos_amostrados[j-1] > destinos_amostrados[j]; j--){
+			t = destinos_amostrados[j]; destinos_amostrados[j] = destinos_amostrados[j-1]; destinos_amostrados[j-1] = t;
+		}
+	
+	n_destinos = amostra;
+}
+
+void relata_amostragem(int passos){
+	
+	/* O tempo de convergência de um destino é o último passo em que alguma
+	 * rota até ele mudou. A média amostral estima a média da rede com um
+	 * intervalo de 95% (aproximação normal, com correção para população
+	 * finita, pois os destinos são sorteados sem reposição). O máximo
+	 * amostral é um limite inferior para a convergência da rede toda.
+	 * Cada pacote carrega n_destinos rotas, então o total de rotas
+	 * anunciadas é extrapolado por N_ROTEADORES/n_destinos. */
+	
+	double soma = 0, soma_q = 0, media, variancia = 0, erro;
+	int i, k, d, c, maximo = 0;
+	
+	for(k=0; k<n_destinos; k++){
+		
+		d = destinos_amostrados[k];
+		c = 0;
+		for(i=0; i<N_ROTEADORES; i++)
+			if(ultima_mudanca[i][d] > c)
+				c = ultima_mudanca[i][d];
+		
+		soma += c;
+		soma_q += (double) c * c;
+		if(c > maximo) maximo = c;
+	}
+	
+	media = soma / n_destinos;
+	if(n_destinos > 1)
+		variancia = (soma_q - n_destinos * media * media) / (n_destinos - 1);
+	if(variancia < 0) variancia = 0;
+	
+	erro = 1.96 * sqrt(variancia / n_destinos) * sqrt((double)(N_ROTEADORES - n_destinos) / (N_ROTEADORES - 1));
+	
+	printf("Amostragem: %d de %d destinos simulados.\n", n_destinos, N_ROTEADORES);
+	printf("Convergência média por destino: %.1f +- %.1f passos (95%%).\n", media, erro);
+	printf("Convergência da rede: pelo menos %d passos (simulação: %d).\n", maximo, passos);
+	printf("Pacotes enviados: %ld; rotas anunciadas estimadas: %.0f.\n", pacotes_enviados, (double) pacotes_enviados * N_ROTEADORES);
+}
+
+/* Formato da exportação colunar. Todos os inteiros têm 32 bits e são
+ * escritos em little-endian, independente da máquina:
+ * 
+ * cabeçalho: "VDTC", versão, número de colunas, linhas por retrato e
+ *            número de retratos
+ * esquema:   para cada coluna, um nome de 16 bytes (completado com '\0')
+ *            e o tipo (1 = inteiro de 32 bits com sinal)
+ * retratos:  o passo, seguido de cada coluna inteira (origem, destino,
+ *            custo, caminho), uma depois da outra
+ * 
+ * Cada retrato tem uma linha por par (roteador, destino simulado). Um
+ * caminho -1 indica rota inexistente. */
+
+#define EXPORTACAO_MAGICA "VDTC"
+#define EXPORTACAO_VERSAO 1
+#define EXPORTACAO_POS_RETRATOS 16	// posição do número de retratos no cabeçalho
+
+static const char * colunas_exportacao[] = {"origem", "destino", "custo", "caminho"};
+
+static void escreve_le32(FILE * f, int32_t valor){
+	
+	uint8_t b[4];
+	uint32_t v = (uint32_t) valor;
+	
+	b[0] = v; b[1] = v >> 8; b[2] = v >> 16; b[3] = v >> 24;
+	fwrite(b, 1, 4, f);
+}
+
+static int retratos_exportados = 0;
+
+FILE * abre_exportacao(const char * arquivo){
+	
+	FILE * f;
+	char nome[16];
+	int c;
+	
+	f = fopen(arquivo, "wb");
+	if(!f){
+		perror(arquivo);
+		return NULL;
+	}
+	
+	fwrite(EXPORTACAO_MAGICA, 1, 4, f);
+	escreve_le32(f, EXPORTACAO_VERSAO);
+	escreve_le32(f, 4);
+	escreve_le32(f, N_ROTEADORES * n_destinos);
+	escreve_le32(f, 0);
+	
+	for(c=0; c<4; c++){
+		memset(nome, 0, sizeof(nome));
+		strncpy(nome, colunas_exportacao[c], sizeof(nome) - 1);
+		fwrite(nome, 1, sizeof(nome), f);
+		escreve_le32(f, 1);
+	}
+	
+	return f;
+}
+
+void exporta_tabelas(FILE * f, roteador * r, int passo){
+	
+	/* As colunas são escritas direto das tabelas, sem cópia intermediária;
+	 * o buffer do stdio agrupa as escritas. */
+	
+	int c, i, k, d, v;
+	
+	escreve_le32(f, passo);
+	
+	for(c=0; c<4; c++)
+		for(i=0; i<N_ROTEADORES; i++)
+			for(k=0; k<n_destinos; k++){
+				
+				d = destinos_amostrados[k];
+				switch(c){
+					case 0:  v = i; break;
+					case 1:  v = d; break;
+					case 2:  v = r[i].rotas[d].custo; break;
+					default: v = r[i].rotas[d].caminho; break;
+				}
+				escreve_le32(f, v);
+			}
+	
+	retratos_exportados++;
+}
+
+void fecha_exportacao(FILE * f){
+	
+	fseek(f, EXPORTACAO_POS_RETRATOS, SEEK_SET);
+	escreve_le32(f, retratos_exportados);
+	fclose(f);
+}
+
+/* As métricas são publicadas com um seqlock: o simulador incrementa a
+ * sequência (ficando ímpar), copia o retrato e incrementa de novo. O
+ * servidor copia o retrato e repete a leitura se a sequência estava ímpar
+ * ou mudou durante a cópia. Assim o simulador nunca espera pelo servidor. */
+static metricas_t metricas_publicadas;
+static unsigned sequencia_metricas = 0;
+static int socket_metricas = -1;
+
+static metricas_t ultimas_metricas;	// último retrato, também usado por publica_estado()
+
+void publica_metricas(long passos, long relaxacoes, long pacotes_descartados){
+	
+	ultimas_metricas.passos              = passos;
+	ultimas_metricas.relaxacoes          = relaxacoes;
+	ultimas_metricas.pacotes_enviados    = pacotes_enviados;
+	ultimas_metricas.pacotes_descartados = pacotes_descartados;
+	ultimas_metricas.ocupacao_entradas   = ocupacao_entradas;
+	ultimas_metricas.tempo_envio         = tempo_envio;
+	ultimas_metricas.tempo_recebimento   = tempo_recebimento;
+	
+	if(socket_metricas < 0) return;
+	
+	__atomic_fetch_add(&sequencia_metricas, 1, __ATOMIC_ACQ_REL);
+	metricas_publicadas = ultimas_metricas;
+	__atomic_fetch_add(&sequencia_metricas, 1, __ATOMIC_RELEASE);
+}
+
+/* Copia um retrato consistente das métricas publicadas. */
+static void le_metricas(metricas_t * m){
+	
+	unsigned antes, depois;
+	
+	do{
+		antes = __atomic_load_n(&sequencia_metricas, __ATOMIC_ACQUIRE);
+		memcpy(m, &metricas_publicadas, sizeof(metricas_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		depois = __atomic_load_n(&sequencia_metricas, __ATOMIC_RELAXED);
+	}while((antes & 1) || antes != depois);
+}
+
+long memoria_residente(void){
+	
+	long paginas = 0, residentes = 0;
+	FILE * f = fopen("/proc/self/statm", "r");
+	
+	if(f){
+		if(fscanf(f, "%ld %ld", &paginas, &residentes) != 2)
+			residentes = 0;
+		fclose(f);
+	}
+	
+	return residentes * getpagesize();
+}
+
+/* Tempo máximo de espera por um cliente e intervalo entre tentativas de
+ * accept() quando faltam recursos (dobra até o máximo), em microssegundos. */
+#define METRICAS_TEMPO_CLIENTE 1000000
+#define METRICAS_ESPERA_MINIMA 10000
+#define METRICAS_ESPERA_MAXIMA 1000000
+
+static void * laco_servidor_metricas(void * arg){
+	
+	/* Atende uma conexão por vez: lê o pedido (qualquer caminho devolve as
+	 * métricas), responde e fecha a conexão. Como a simulação não pode
+	 * parar por causa do servidor, um cliente lento é abandonado após
+	 * METRICAS_TEMPO_CLIENTE e um cliente que desconecta não gera SIGPIPE. */
+	
+	char pedido[1024], corpo[2048], resposta[2304];
+	struct timeval limite = { METRICAS_TEMPO_CLIENTE / 1000000, METRICAS_TEMPO_CLIENTE % 1000000 };
+	metricas_t m;
+	int cliente, tamanho, espera = METRICAS_ESPERA_MINIMA;
+	
+	(void) arg;
+	
+	while(1){
+		
+		cliente = accept(socket_metricas, NULL, NULL);
+		if(cliente < 0){
+			
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			
+			/* Com o socket inválido não há como se recuperar. */
+			if(errno == EBADF || errno == EINVAL || errno == ENOTSOCK){
+				perror("metricas");
+				break;
+			}
+			
+			/* Falta de descritores ou de memória: espera antes de tentar de novo. */
+			usleep(espera);
+			if(espera < METRICAS_ESPERA_MAXIMA)
+				espera *= 2;
+			continue;
+		}
+		espera = METRICAS_ESPERA_MINIMA;
+		
+		setsockopt(cliente, SOL_SOCKET, SO_RCVTIMEO, &limite, sizeof(limite));
+		setsockopt(cliente, SOL_SOCKET, SO_SNDTIMEO, &limite, sizeof(limite));
+		
+		if(read(cliente, pedido, sizeof(pedido)) < 0){
+			close(cliente);
+			continue;
+		}
+		
+		le_metricas(&m);
+		
+		tamanho = snprintf(corpo, sizeof(corpo),
+			"# HELP vd_passos_total Passos simulados.\n"
+			"# TYPE vd_passos_total counter\n"
+			"vd_passos_total %ld\n"
+			"# HELP vd_relaxacoes_total Rotas alteradas pelo recebimento de pacotes.\n"
+			"# TYPE vd_relaxacoes_total counter\n"
+			"vd_relaxacoes_total %ld\n"
+			"# HELP vd_pacotes_enviados_total Pacotes entregues aos buffers de entrada.\n"
+			"# TYPE vd_pacotes_enviados_total counter\n"
+			"vd_pacotes_enviados_total %ld\n"
+			"# HELP vd_pacotes_descartados_total Pacotes descartados por buffer cheio.\n"
+			"# TYPE vd_pacotes_descartados_total counter\n"
+			"vd_pacotes_descartados_total %ld\n"
+			"# HELP vd_ocupacao_entradas Pacotes nos buffers de entrada ao fim do último envio.\n"
+			"# TYPE vd_ocupacao_entradas gauge\n"
+			"vd_ocupacao_entradas %ld\n"
+			"# HELP vd_tempo_fase_segundos_total Tempo gasto em cada fase do passo.\n"
+			"# TYPE vd_tempo_fase_segundos_total counter\n"
+			"vd_tempo_fase_segundos_total{fase=\"envio\"} %.6f\n"
+			"vd_tempo_fase_segundos_total{fase=\"recebimento\"} %.6f\n"
+			"# HELP vd_memoria_residente_bytes Memória residente do processo.\n"
+			"# TYPE vd_memoria_residente_bytes gauge\n"
+			"vd_memoria_residente_bytes %ld\n",
+			m.passos, m.relaxacoes, m.pacotes_enviados, m.pacotes_descartados,
+			m.ocupacao_entradas, m.tempo_envio, m.tempo_recebimento, memoria_residente());
+		
+		tamanho = snprintf(resposta, sizeof(resposta),
+			"HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %d\r\n"
+			"Connection: close\r\n\r\n%s", tamanho, corpo);
+		
+		if(send(cliente, resposta, tamanho, MSG_NOSIGNAL) < 0)
+			perror("metricas");
+		close(cliente);
+	}
+	
+	return NULL;
+}
+
+int inicia_servidor_metricas(int porta){
+	
+	struct sockaddr_in endereco;
+	pthread_t thread;
+	int opcao = 1;
+	
+	socket_metricas = socket(AF_INET, SOCK_STREAM, 0);
+	if(socket_metricas < 0){
+		perror("socket");
+		return -1;
+	}
+	
+	setsockopt(socket_metricas, SOL_SOCKET, SO_REUSEADDR, &opcao, sizeof(opcao));
+	
+	memset(&endereco, 0, sizeof(endereco));
+	endereco.sin_family      = AF_INET;
+	endereco.sin_port        = htons(porta);
+	endereco.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	
+	if(bind(socket_metricas, (struct sockaddr *) &endereco, sizeof(endereco)) < 0 || listen(socket_metricas, 8) < 0){
+		perror("metricas");
+		close(socket_metricas);
+		socket_metricas = -1;
+		return -1;
+	}
+	
+	pthread_create(&thread, NULL, laco_servidor_metricas, NULL);
+	pthread_detach(thread);
+	
+	printf("Métricas disponíveis em http://127.0.0.1:%d/metrics\n", porta);
+	
+	return 0;
+}
+
+static estado_compartilhado_t * estado_compartilhado = NULL;
+
+int inicia_estado_compartilhado(const char * nome){
+	
+	/* A região continua existindo depois do fim da simulação, para que o
+	 * visualizador possa ler o estado final. Ela é recriada a cada execução. */
+	
+	int fd;
+	
+	fd = shm_open(nome, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0 || ftruncate(fd, sizeof(estado_compartilhado_t)) < 0){
+		perror(nome);
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	
+	estado_compartilhado = mmap(NULL, sizeof(estado_compartilhado_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(estado_compartilhado == MAP_FAILED){
+		perror(nome);
+		estado_compartilhado = NULL;
+		return -1;
+	}
+	
+	memcpy(estado_compartilhado->magica, ESTADO_MAGICA, 4);
+	estado_compartilhado->versao       = ESTADO_VERSAO;
+	estado_compartilhado->n_roteadores = N_ROTEADORES;
+	
+	/* Sequência ímpar até a primeira publicação: ainda não há tabelas. */
+	estado_compartilhado->sequencia = 1;
+	
+	return 0;
+}
+
+void publica_estado(roteador * r){
+	
+	int i;
+	int primeira;
+	
+	if(!estado_compartilhado) return;
+	
+	/* Na primeira publicação todas as tabelas são copiadas. */
+	primeira = (estado_compartilhado->sequencia == 1);
+	if(!primeira)
+		__atomic_fetch_add(&estado_compartilhado->sequencia, 1, __ATOMIC_ACQ_REL);
+	
+	memset(estado_compartilhado->alterados, 0, sizeof(estado_compartilhado->alterados));
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		if(primeira || roteador_alterado[i]){
+			memcpy(estado_compartilhado->rotas[i], r[i].rotas, sizeof(r[i].rotas));
+			if(roteador_alterado[i])
+				estado_compartilhado->alterados[i / 8] |= 1 << (i % 8);
+			roteador_alterado[i] = 0;
+		}
+	
+	estado_compartilhado->metricas = ultimas_metricas;
+	
+	__atomic_fetch_add(&estado_compartilhado->sequencia, 1, __ATOMIC_RELEASE);
+}
+
+/* Tamanho, em pixels, de cada célula do mapa de calor. */
+#define QUADRO_CELULA 24
+
+/* Converte um valor entre 0 e 1 em uma cor de azul (0) a vermelho (1). */
+static void cor_calor(double v, uint8_t * rgb){
+	
+	if(v < 0) v = 0;
+	if(v > 1) v = 1;
+	
+	rgb[0] = (uint8_t)(255 * v);
+	rgb[1] = (uint8_t)(255 * (1 - 2 * fabs(v - 0.5)));
+	rgb[2] = (uint8_t)(255 * (1 - v));
+}
+
+int exporta_quadro(roteador * r, const char * prefixo, int passo){
+	
+	/* O quadro tem a matriz de custos (linha = roteador, coluna = destino),
+	 * com cor de azul (custo baixo) a vermelho (INFINITO); rotas
+	 * inexistentes ficam pretas e as que mudaram no passo ganham borda
+	 * branca. À direita, uma barra por roteador mostra quantas rotas dele
+	 * mudaram no passo; abaixo, uma barra por destino mostra quantos
+	 * roteadores mudaram a rota até ele. Assim a onda de convergência
+	 * aparece de quadro em quadro. */
+	
+	int largura = (N_ROTEADORES + 1) * QUADRO_CELULA;
+	int altura  = (N_ROTEADORES + 1) * QUADRO_CELULA;
+	int mudancas_roteador[N_ROTEADORES], mudancas_destino[N_ROTEADORES];
+	uint8_t * imagem, * px, rgb[3];
+	char arquivo[512];
+	int i, j, x, y, borda;
+	FILE * f;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		mudancas_roteador[i] = mudancas_destino[i] = 0;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES; j++)
+			if(i != j && ultima_mudanca[i][j] == passo){
+				mudancas_roteador[i]++;
+				mudancas_destino[j]++;
+			}
+	
+	imagem = calloc(largura * altura, 3);
+	if(!imagem) return -1;
+	
+	for(y=0; y<altura; y++)
+		for(x=0; x<largura; x++){
+			
+			i  = y / QUADRO_CELULA;
+			j  = x / QUADRO_CELULA;
+			px = imagem + 3 * (y * largura + x);
+			
+			if(i < N_ROTEADORES && j < N_ROTEADORES){
+				
+				borda = (x % QUADRO_CELULA < 2 || y % QUADRO_CELULA < 2);
+				
+				if(borda && i != j && ultima_mudanca[i][j] == passo)
+					memset(px, 255, 3);
+				else if(i == j || r[i].rotas[j].caminho == -1)
+					memset(px, 0, 3);
+				else{
+					cor_calor((double) r[i].rotas[j].custo / INFINITO, rgb);
+					memcpy(px, rgb, 3);
+				}
+				
+			}else if(i < N_ROTEADORES){
+				
+				// Barra horizontal: rotas do roteador i que mudaram
+				if(x % QUADRO_CELULA < QUADRO_CELULA * mudancas_roteador[i] / (N_ROTEADORES - 1))
+					memset(px, 255, 3);
+				
+			}else if(j < N_ROTEADORES){
+				
+				// Barra vertical: roteadores que mudaram a rota até j
+				if(y % QUADRO_CELULA < QUADRO_CELULA * mudancas_destino[j] / (N_ROTEADORES - 1))
+					memset(px, 255, 3);
+			}
+		}
+	
+	snprintf(arquivo, sizeof(arquivo), "%s_%05d.ppm", prefixo, passo);
+	f = fopen(arquivo, "wb");
+	if(!f){
+		perror(arquivo);
+		free(imagem);
+		return -1;
+	}
+	
+	fprintf(f, "P6\n%d %d\n255\n", largura, altura);
+	fwrite(imagem, 3, largura * altura, f);
+	fclose(f);
+	free(imagem);
+	
+	return 0;
+}
+
+void relata_memoria(long estimativa, long residente_inicial){
+	
+	/* ru_maxrss é dado em kilobytes no Linux. */
+	
+	struct rusage uso;
+	long pico;
+	
+	getrusage(RUSAGE_SELF, &uso);
+	pico = uso.ru_maxrss * 1024L;
+	
+	printf("Memória: estimativa %ld bytes; pico residente %ld bytes (%ld acima do início).\n",
+		estimativa, pico, pico - residente_inicial);
+}
+
+/* Formato RIPv2 (RFC 2453): cabeçalho de 4 bytes (comando 2 = resposta,
+ * versão 2) seguido de uma entrada de 20 bytes por rota, com os campos
+ * em ordem de rede: família (2 = IP), marca de rota, endereço, máscara,
+ * próximo salto e métrica. O roteador de ID i é representado pelo
+ * endereço 10.0.x.y, com x.y = i+1; o próximo salto 0.0.0.0 indica rota
+ * inexistente. A métrica carrega o custo sem conversão, já que a métrica
+ * do simulador é arbitrária. O remetente é identificado pela porta de
+ * origem, como um roteador RIP faria com o endereço de origem.
+ * 
+ * O RIP limita uma mensagem a 25 rotas; com mais destinos simulados a
+ * mensagem é enviada inteira mesmo assim. */
+
+#define RIP_CABECALHO 4
+#define RIP_ENTRADA 20
+#define RIP_TAMANHO_MAXIMO (RIP_CABECALHO + RIP_ENTRADA * N_ROTEADORES)
+
+static int sockets_udp[N_ROTEADORES];
+static int porta_base_udp;
+static long datagramas_enviados = 0, datagramas_recebidos = 0, datagramas_estranhos = 0;
+static long datagramas_esperados = 0;	// enviados com sucesso e ainda não recebidos
+static double inicio_emulacao;
+static int epoll_udp = -1;
+
+
+/* Anéis do io_uring, configurados com chamadas de sistema diretas (sem a
+ * liburing). Os envios de um passo inteiro são enfileirados como
+ * IORING_OP_SENDMSG e submetidos com uma única io_uring_enter(), no fim
+ * da fase de envio (ou antes, se a fila encher). Cada envio precisa que
+ * sua mensagem, endereço e iovec continuem válidos até a conclusão, por
+ * isso ficam em vetores indexados pela posição na fila. Se o io_uring não
+ * estiver disponível, cada roteador envia com sendmmsg().
+ * 
+ * A recepção usa um segundo anel, para que as conclusões de envio e de
+ * recebimento não se misturem: cada socket tem um IORING_OP_RECVMSG
+ * multishot, armado uma vez, que escreve os datagramas em buffers de um
+ * anel de buffers registrado no kernel (IORING_REGISTER_PBUF_RING). O
+ * buffer volta ao anel assim que o datagrama é copiado para a entrada do
+ * roteador. Sem suporte a isso, a recepção usa epoll e recvmmsg(). */
+
+#define ANEL_ENTRADAS (N_ROTEADORES * N_ROTEADORES < 4096 ? N_ROTEADORES * N_ROTEADORES : 4096)
+#define RECEPCAO_GRUPO 0		// grupo de buffers da recepção
+#define RECEPCAO_ESPERA 10000000	// espera máxima por datagramas em trânsito, em ns
+
+typedef struct anel_t{
+	int fd;
+	void * mapa_sq, * mapa_cq;
+	size_t tamanho_sq, tamanho_cq, tamanho_sqes;
+	unsigned entradas;		// capacidade da fila de submissão
+	unsigned * sq_cauda, * sq_mascara, * sq_vetor;
+	unsigned * cq_cabeca, * cq_cauda, * cq_mascara;
+	struct io_uring_sqe * sqes;
+	struct io_uring_cqe * cqes;
+	unsigned pendentes;
+}anel_t;
+
+static anel_t anel = { .fd = -1 };
+static anel_t recepcao = { .fd = -1 };
+
+static uint8_t anel_mensagens[N_ROTEADORES][RIP_TAMANHO_MAXIMO];
+static struct iovec anel_iovs[N_ROTEADORES];
+static struct msghdr anel_cabecalhos[ANEL_ENTRADAS];
+static struct sockaddr_in anel_enderecos[ANEL_ENTRADAS];
+
+static struct io_uring_buf_ring * recepcao_buffers = NULL;	// anel de buffers registrado
+static uint8_t * recepcao_memoria = NULL;
+static unsigned recepcao_n_buffers, recepcao_tamanho_buffer;
+static size_t recepcao_tamanho_anel;
+static struct msghdr recepcao_modelo;	// só o tamanho do endereço importa
+static char recepcao_armada[N_ROTEADORES];
+static pid_t recepcao_dono;		// processo que armou os recebimentos
+
+/* Cria um anel com "entradas" submissões e ao menos "conclusoes" conclusões.
+ * Retorna -1 se o io_uring não estiver disponível. */
+static int inicia_anel(anel_t * a, unsigned entradas, unsigned conclusoes){
+	
+	struct io_uring_params p;
+	uint8_t * sq, * cq;
+	
+	memset(&p, 0, sizeof(p));
+	p.flags      = IORING_SETUP_CQSIZE;
+	p.cq_entries = conclusoes;
+	a->fd = syscall(__NR_io_uring_setup, entradas, &p);
+	if(a->fd < 0)
+		return -1;
+	
+	a->tamanho_sq   = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	a->tamanho_cq   = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	a->tamanho_sqes = p.sq_entries * sizeof(struct io_uring_sqe);
+	a->entradas     = p.sq_entries;
+	
+	sq = mmap(NULL, a->tamanho_sq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, a->tamanho_cq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_CQ_RING);
+	a->sqes = mmap(NULL, a->tamanho_sqes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->fd, IORING_OFF_SQES);
+	a->mapa_sq = sq;
+	a->mapa_cq = cq;
+	
+	if(sq == MAP_FAILED || cq == MAP_FAILED || a->sqes == MAP_FAILED){
+		close(a->fd);
+		a->fd = -1;
+		return -1;
+	}
+	
+	a->sq_cauda   = (unsigned *)(sq + p.sq_off.tail);
+	a->sq_mascara = (unsigned *)(sq + p.sq_off.ring_mask);
+	a->sq_vetor   = (unsigned *)(sq + p.sq_off.array);
+	a->cq_cabeca  = (unsigned *)(cq + p.cq_off.head);
+	a->cq_cauda   = (unsigned *)(cq + p.cq_off.tail);
+	a->cq_mascara = (unsigned *)(cq + p.cq_off.ring_mask);
+	a->cqes       = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	a->pendentes  = 0;
+	
+	return 0;
+}
+
+/* Desfaz o mapeamento e fecha o anel. */
+static void fecha_anel(anel_t * a){
+	
+	if(a->fd < 0) return;
+	
+	munmap(a->mapa_sq, a->tamanho_sq);
+	munmap(a->mapa_cq, a->tamanho_cq);
+	munmap(a->sqes, a->tamanho_sqes);
+	close(a->fd);
+	a->fd = -1;
+}
+
+/* Reserva uma entrada na fila de submissão do anel. */
+static struct io_uring_sqe * nova_submissao(anel_t * a){
+	
+	unsigned cauda = *a->sq_cauda;
+	struct io_uring_sqe * sqe = &a->sqes[cauda & *a->sq_mascara];
+	
+	memset(sqe, 0, sizeof(*sqe));
+	a->sq_vetor[cauda & *a->sq_mascara] = cauda & *a->sq_mascara;
+	__atomic_store_n(a->sq_cauda, cauda + 1, __ATOMIC_RELEASE);
+	a->pendentes++;
+	
+	return sqe;
+}
+
+/* Devolve o buffer "id" ao anel de buffers da recepção. */
+static void devolve_buffer(unsigned id){
+	
+	unsigned short cauda = recepcao_buffers->tail;
+	struct io_uring_buf * b = &recepcao_buffers->bufs[cauda & (recepcao_n_buffers - 1)];
+	
+	b->addr = (uint64_t)(uintptr_t)(recepcao_memoria + (size_t) id * recepcao_tamanho_buffer);
+	b->len  = recepcao_tamanho_buffer;
+	b->bid  = id;
+	__atomic_store_n(&recepcao_buffers->tail, cauda + 1, __ATOMIC_RELEASE);
+}
+
+/* Arma o recebimento multishot do socket do roteador. */
+static void arma_recepcao(int r_idx){
+	
+	struct io_uring_sqe * sqe = nova_submissao(&recepcao);
+	
+	sqe->opcode    = IORING_OP_RECVMSG;
+	sqe->fd        = sockets_udp[r_idx];
+	sqe->addr      = (uint64_t)(uintptr_t) &recepcao_modelo;
+	sqe->ioprio    = IORING_RECV_MULTISHOT;
+	sqe->flags     = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = RECEPCAO_GRUPO;
+	sqe->user_data = r_idx;
+	recepcao_armada[r_idx] = 1;
+}
+
+/* Fecha o anel de recepção e libera seus buffers. Os recebimentos armados
+ * seguram os sockets até terminarem, e o kernel só os termina depois de
+ * fechado o anel, em segundo plano; por isso são cancelados antes, para
+ * que as portas fiquem livres assim que os sockets forem fechados. Um
+ * processo filho (ver ramifica_cenarios()) compartilha o anel com o pai e
+ * só fecha a sua cópia. */
+static void fecha_recepcao(void){
+	
+	struct io_uring_getevents_arg espera;
+	struct __kernel_timespec limite = {0, RECEPCAO_ESPERA};
+	struct io_uring_sqe * sqe;
+	unsigned cabeca;
+	int r_idx, armadas = 0;
+	
+	if(recepcao.fd >= 0 && recepcao_dono == getpid()){
+		
+		for(r_idx=0; r_idx<N_ROTEADORES; r_idx++)
+			armadas += recepcao_armada[r_idx];
+		
+		sqe = nova_submissao(&recepcao);
+		sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+		sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+		sqe->user_data    = N_ROTEADORES;
+		
+		memset(&espera, 0, sizeof(espera));
+		espera.ts = (uint64_t)(uintptr_t) &limite;
+		
+		/* Espera a conclusão final de cada recebimento (sem IORING_CQE_F_MORE). */
+		while(armadas > 0){
+			
+			if(syscall(__NR_io_uring_enter, recepcao.fd, recepcao.pendentes, 1,
+			           IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &espera, sizeof(espera)) < 0 && errno != EINTR)
+				break;
+			recepcao.pendentes = 0;
+			
+			cabeca = *recepcao.cq_cabeca;
+			while(cabeca != __atomic_load_n(recepcao.cq_cauda, __ATOMIC_ACQUIRE)){
+				r_idx = recepcao.cqes[cabeca & *recepcao.cq_mascara].user_data;
+				if(r_idx < N_ROTEADORES && !(recepcao.cqes[cabeca & *recepcao.cq_mascara].flags & IORING_CQE_F_MORE) &&
+				   recepcao_armada[r_idx]){
+					recepcao_armada[r_idx] = 0;
+					armadas--;
+				}
+				cabeca++;
+			}
+			__atomic_store_n(recepcao.cq_cabeca, cabeca, __ATOMIC_RELEASE);
+		}
+	}
+	
+	fecha_anel(&recepcao);
+	
+	if(recepcao_buffers)
+		munmap(recepcao_buffers, recepcao_tamanho_anel);
+	free(recepcao_memoria);
+	recepcao_buffers = NULL;
+	recepcao_memoria = NULL;
+}
+
+/* Cria o anel de recepção, registra os buffers e arma todos os sockets.
+ * Retorna -1 se o kernel não suportar a recepção pelo io_uring. */
+static int inicia_recepcao(void){
+	
+	/* Em um passo chegam no máximo N_ROTEADORES x N_ROTEADORES datagramas.
+	 * O anel de buffers precisa de uma potência de 2, limitada pelo kernel;
+	 * se os buffers acabarem, os datagramas esperam no socket. */
+	
+	struct io_uring_buf_reg registro;
+	unsigned i;
+	
+	for(recepcao_n_buffers = 1; recepcao_n_buffers < ANEL_ENTRADAS; recepcao_n_buffers <<= 1);
+	recepcao_tamanho_buffer = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + RIP_TAMANHO_MAXIMO;
+	recepcao_tamanho_anel   = recepcao_n_buffers * sizeof(struct io_uring_buf);
+	
+	if(inicia_anel(&recepcao, N_ROTEADORES, recepcao_n_buffers + N_ROTEADORES))
+		return -1;
+	
+	recepcao_buffers = mmap(NULL, recepcao_tamanho_anel, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	recepcao_memoria = malloc((size_t) recepcao_n_buffers * recepcao_tamanho_buffer);
+	if(recepcao_buffers == MAP_FAILED || !recepcao_memoria){
+		recepcao_buffers = NULL;
+		fecha_recepcao();
+		return -1;
+	}
+	
+	memset(&registro, 0, sizeof(registro));
+	registro.ring_addr    = (uint64_t)(uintptr_t) recepcao_buffers;
+	registro.ring_entries = recepcao_n_buffers;
+	registro.bgid         = RECEPCAO_GRUPO;
+	if(syscall(__NR_io_uring_register, recepcao.fd, IORING_REGISTER_PBUF_RING, &registro, 1) < 0){
+		fecha_recepcao();
+		return -1;
+	}
+	
+	recepcao_buffers->tail = 0;
+	for(i=0; i<recepcao_n_buffers; i++)
+		devolve_buffer(i);
+	
+	memset(&recepcao_modelo, 0, sizeof(recepcao_modelo));
+	recepcao_modelo.msg_namelen = sizeof(struct sockaddr_in);
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		arma_recepcao(i);
+	recepcao_dono = getpid();
+	
+	if(syscall(__NR_io_uring_enter, recepcao.fd, recepcao.pendentes, 0, 0, NULL, 0) < 0){
+		fecha_recepcao();
+		return -1;
+	}
+	recepcao.pendentes = 0;
+	
+	return 0;
+}
+
+/* Retorna 1 se "remetente" é um vizinho configurado do roteador. */
+static int vizinho_configurado(int r_idx, int remetente){
+	
+	int vizinho;
+	
+	if(remetente < 0 || remetente >= N_ROTEADORES)
+		return 0;
+	
+	for(vizinho=0; vizinho<N_ROTEADORES; vizinho++)
+		if(conexoes_enlaces[r_idx][vizinho] == remetente)
+			return 1;
+	
+	return 0;
+}
+
+static void escreve_be16(uint8_t * p, uint16_t v){ p[0] = v >> 8; p[1] = v; }
+static void escreve_be32(uint8_t * p, uint32_t v){ p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static uint32_t le_be32(const uint8_t * p){ return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+
+static uint32_t endereco_roteador(int id){ return id < 0 ? 0 : (10u << 24) | (uint32_t)(id + 1); }
+static int roteador_do_endereco(uint32_t e){ return e == 0 ? -1 : (int)(e & 0xffff) - 1; }
+
+/* Serializa as rotas do pacote. Retorna o tamanho da mensagem. */
+static int serializa_rip(const pacote_t * pkt, uint8_t * buf){
+	
+	uint8_t * e;
+	int k;
+	
+	buf[0] = 2;		// comando: resposta
+	buf[1] = 2;		// versão
+	escreve_be16(buf + 2, 0);
+	
+	for(k=0; k<n_destinos; k++){
+		e = buf + RIP_CABECALHO + k * RIP_ENTRADA;
+		escreve_be16(e,      2);
+		escreve_be16(e + 2,  0);
+		escreve_be32(e + 4,  endereco_roteador(pkt->rotas[k].destino));
+		escreve_be32(e + 8,  0xffffffff);
+		escreve_be32(e + 12, endereco_roteador(pkt->rotas[k].caminho));
+		escreve_be32(e + 16, pkt->rotas[k].custo);
+	}
+	
+	return RIP_CABECALHO + n_destinos * RIP_ENTRADA;
+}
+
+/* Preenche um pacote a partir de uma mensagem. Retorna -1 se a mensagem
+ * não for uma resposta RIPv2 com a quantidade esperada de rotas. */
+static int desserializa_rip(const uint8_t * buf, int tamanho, int remetente, pacote_t * pkt){
+	
+	const uint8_t * e;
+	int k, destino;
+	
+	if(tamanho != RIP_CABECALHO + n_destinos * RIP_ENTRADA || buf[0] != 2 || buf[1] != 2)
+		return -1;
+	
+	pkt->remetente = remetente;
+	
+	for(k=0; k<n_destinos; k++){
+		e = buf + RIP_CABECALHO + k * RIP_ENTRADA;
+		destino = roteador_do_endereco(le_be32(e + 4));
+		if(destino < 0 || destino >= N_ROTEADORES)
+			return -1;
+		pkt->rotas[k].destino = destino;
+		pkt->rotas[k].caminho = roteador_do_endereco(le_be32(e + 12));
+		pkt->rotas[k].custo   = (int) le_be32(e + 16);
+	}
+	
+	return 0;
+}
+
+int inicia_emulacao_udp(int porta_base){
+	
+	struct sockaddr_in endereco;
+	int i;
+	
+	porta_base_udp = porta_base;
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		sockets_udp[i] = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		if(sockets_udp[i] < 0){
+			perror("socket");
+			return -1;
+		}
+		
+		memset(&endereco, 0, sizeof(endereco));
+		endereco.sin_family      = AF_INET;
+		endereco.sin_port        = htons(porta_base + i);
+		endereco.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		
+		if(bind(sockets_udp[i], (struct sockaddr *) &endereco, sizeof(endereco)) < 0){
+			fprintf(stderr, "Porta %d: ", porta_base + i);
+			perror("bind");
+			return -1;
+		}
+	}
+	
+	/* Os sockets com datagramas esperando são descobertos pelo epoll, de
+	 * modo que o recebimento não precisa consultar todos os roteadores. */
+	epoll_udp = epoll_create1(0);
+	if(epoll_udp < 0){
+		perror("epoll");
+		return -1;
+	}
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		struct epoll_event evento;
+		
+		evento.events   = EPOLLIN;
+		evento.data.u32 = i;
+		if(epoll_ctl(epoll_udp, EPOLL_CTL_ADD, sockets_udp[i], &evento) < 0){
+			perror("epoll");
+			return -1;
+		}
+	}
+	
+	if(inicia_anel(&anel, ANEL_ENTRADAS, 2 * ANEL_ENTRADAS))
+		printf("io_uring indisponível; usando sendmmsg().\n");
+	else if(inicia_recepcao())
+		printf("Recepção multishot do io_uring indisponível; usando recvmmsg().\n");
+	
+	emulacao_udp = 1;
+	inicio_emulacao = relogio();
+	
+	return 0;
+}
+
+/* Enfileira no anel o envio do pacote a cada vizinho. O envio de fato só
+ * acontece em descarrega_envios_udp(). */
+static int enfileira_udp(const pacote_t * pkt, int src){
+	
+	struct io_uring_sqe * sqe;
+	unsigned posicao;
+	int vizinho, dst, pkt_drop = 0;
+	
+	anel_iovs[src].iov_base = anel_mensagens[src];
+	anel_iovs[src].iov_len  = serializa_rip(pkt, anel_mensagens[src]);
+	
+	for(vizinho=0; vizinho<N_ROTEADORES; vizinho++){
+		
+		dst = conexoes_enlaces[src][vizinho];
+		if(dst < 0) continue;
+		
+		/* Com a fila cheia, o que já está nela é enviado antes. A
+		 * mensagem de src continua válida: ela só muda na próxima
+		 * chamada para o mesmo roteador. */
+		if(anel.pendentes == anel.entradas || anel.pendentes == ANEL_ENTRADAS)
+			pkt_drop += descarrega_envios_udp();
+		
+		posicao = anel.pendentes;
+		
+		memset(&anel_enderecos[posicao], 0, sizeof(anel_enderecos[posicao]));
+		anel_enderecos[posicao].sin_family      = AF_INET;
+		anel_enderecos[posicao].sin_port        = htons(porta_base_udp + dst);
+		anel_enderecos[posicao].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		
+		memset(&anel_cabecalhos[posicao], 0, sizeof(anel_cabecalhos[posicao]));
+		anel_cabecalhos[posicao].msg_name    = &anel_enderecos[posicao];
+		anel_cabecalhos[posicao].msg_namelen = sizeof(anel_enderecos[posicao]);
+		anel_cabecalhos[posicao].msg_iov     = &anel_iovs[src];
+		anel_cabecalhos[posicao].msg_iovlen  = 1;
+		
+		sqe = nova_submissao(&anel);
+		sqe->opcode    = IORING_OP_SENDMSG;
+		sqe->fd        = sockets_udp[src];
+		sqe->addr      = (uint64_t)(uintptr_t) &anel_cabecalhos[posicao];
+		sqe->len       = 1;
+		sqe->user_data = (uint64_t) src * N_ROTEADORES + dst;
+	}
+	
+	return pkt_drop;
+}
+
+int descarrega_envios_udp(void){
+	
+	/* A fila comporta um passo inteiro (um envio por enlace) até
+	 * ANEL_ENTRADAS; acima disso enfileira_udp() descarrega antes. */
+	
+	struct io_uring_cqe * cqe;
+	unsigned cabeca;
+	int src, dst, pkt_drop = 0;
+	
+	if(anel.fd < 0 || anel.pendentes == 0)
+		return 0;
+	
+	if(syscall(__NR_io_uring_enter, anel.fd, anel.pendentes, anel.pendentes, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+		perror("io_uring_enter");
+	
+	cabeca = *anel.cq_cabeca;
+	while(cabeca != __atomic_load_n(anel.cq_cauda, __ATOMIC_ACQUIRE)){
+		
+		cqe = &anel.cqes[cabeca & *anel.cq_mascara];
+		src = cqe->user_data / N_ROTEADORES;
+		dst = cqe->user_data % N_ROTEADORES;
+		
+		if(cqe->res < 0)
+			pkt_drop++;
+		else{
+			pacotes_enlace[src][dst]++;
+			datagramas_enviados++;
+			datagramas_esperados++;
+		}
+		cabeca++;
+	}
+	__atomic_store_n(anel.cq_cabeca, cabeca, __ATOMIC_RELEASE);
+	
+	anel.pendentes = 0;
+	
+	return pkt_drop;
+}
+
+int envia_udp(const pacote_t * pkt, int src){
+	
+	/* A mensagem é serializada uma vez e enviada a todos os vizinhos com
+	 * uma única chamada sendmmsg(). No loopback a entrega é síncrona: ao
+	 * retornar, os datagramas já estão nos sockets dos destinatários. */
+	
+	uint8_t buf[RIP_TAMANHO_MAXIMO];
+	struct sockaddr_in enderecos[N_ROTEADORES];
+	struct mmsghdr mensagens[N_ROTEADORES];
+	struct iovec iov;
+	int destinos[N_ROTEADORES];
+	int vizinho, dst, n = 0, enviados, i;
+	
+	if(anel.fd >= 0)
+		return enfileira_udp(pkt, src);
+	
+	iov.iov_base = buf;
+	iov.iov_len  = serializa_rip(pkt, buf);
+	
+	for(vizinho=0; vizinho<N_ROTEADORES; vizinho++){
+		
+		dst = conexoes_enlaces[src][vizinho];
+		if(dst < 0) continue;
+		
+		memset(&enderecos[n], 0, sizeof(enderecos[n]));
+		enderecos[n].sin_family      = AF_INET;
+		enderecos[n].sin_port        = htons(porta_base_udp + dst);
+		enderecos[n].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		
+		memset(&mensagens[n], 0, sizeof(mensagens[n]));
+		mensagens[n].msg_hdr.msg_name    = &enderecos[n];
+		mensagens[n].msg_hdr.msg_namelen = sizeof(enderecos[n]);
+		mensagens[n].msg_hdr.msg_iov     = &iov;
+		mensagens[n].msg_hdr.msg_iovlen  = 1;
+		
+		destinos[n++] = dst;
+	}
+	
+	if(n == 0) return 0;
+	
+	enviados = sendmmsg(sockets_udp[src], mensagens, n, 0);
+	if(enviados < 0) enviados = 0;
+	
+	for(i=0; i<enviados; i++)
+		pacotes_enlace[src][destinos[i]]++;
+	
+	datagramas_enviados  += enviados;
+	datagramas_esperados += enviados;
+	
+	return n - enviados;
+}
+
+/* Copia um datagrama recebido por r_idx para o buffer de entrada. Datagramas
+ * de portas que não são de um vizinho configurado são descartados sem
+ * contar como pacote dropado. Retorna 1 se o buffer de entrada estava cheio. */
+static int entrega_datagrama(roteador * r, int r_idx, const struct sockaddr_in * origem, const uint8_t * buf, int tamanho){
+	
+	int remetente = ntohs(origem->sin_port) - porta_base_udp;
+	
+	datagramas_recebidos++;
+	
+	if(origem->sin_addr.s_addr != htonl(INADDR_LOOPBACK) || !vizinho_configurado(r_idx, remetente)){
+		datagramas_estranhos++;
+		return 0;
+	}
+	
+	if(datagramas_esperados > 0)
+		datagramas_esperados--;
+	
+	if(r[r_idx].idx == PKT_BUFFER)
+		return 1;
+	
+	if(desserializa_rip(buf, tamanho, remetente, &r[r_idx].entrada[r[r_idx].idx]))
+		return 0;
+	
+	r[r_idx].idx++;
+	pacotes_enviados++;
+	
+	return 0;
+}
+
+/* Recebe pelo anel de recepção: colhe as conclusões dos recebimentos
+ * multishot até chegarem os datagramas enviados no passo (ou se esgotar
+ * RECEPCAO_ESPERA), devolvendo cada buffer e rearmando os sockets cujo
+ * recebimento terminou (por falta de buffers, por exemplo). */
+static int recebe_udp_anel(roteador * r){
+	
+	struct io_uring_getevents_arg espera;
+	struct __kernel_timespec limite = {0, RECEPCAO_ESPERA};
+	const struct io_uring_recvmsg_out * saida;
+	struct io_uring_cqe * cqe;
+	struct sockaddr_in origem;
+	const uint8_t * buf;
+	unsigned cabeca, id;
+	int r_idx, esgotou = 0, falhou = 0, pkt_drop = 0;
+	
+	memset(&espera, 0, sizeof(espera));
+	espera.ts = (uint64_t)(uintptr_t) &limite;
+	
+	while(1){
+		
+		cabeca = *recepcao.cq_cabeca;
+		while(cabeca != __atomic_load_n(recepcao.cq_cauda, __ATOMIC_ACQUIRE)){
+			
+			cqe = &recepcao.cqes[cabeca & *recepcao.cq_mascara];
+			r_idx = cqe->user_data;
+			
+			if(cqe->flags & IORING_CQE_F_BUFFER){
+				
+				id   = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+				buf  = recepcao_memoria + (size_t) id * recepcao_tamanho_buffer;
+				saida = (const struct io_uring_recvmsg_out *) buf;
+				
+				if(cqe->res >= 0 && saida->namelen >= sizeof(origem) && !(saida->flags & MSG_TRUNC)){
+					memcpy(&origem, buf + sizeof(*saida), sizeof(origem));
+					pkt_drop += entrega_datagrama(r, r_idx, &origem,
+						buf + sizeof(*saida) + recepcao_modelo.msg_namelen, saida->payloadlen);
+				}
+				devolve_buffer(id);
+			}
+			
+			/* Sem buffers livres o recebimento termina e é rearmado;
+			 * qualquer outro erro indica que o kernel não o suporta. */
+			if(!(cqe->flags & IORING_CQE_F_MORE)){
+				recepcao_armada[r_idx] = 0;
+				if(cqe->res < 0 && cqe->res != -ENOBUFS)
+					falhou = 1;
+			}
+			
+			cabeca++;
+		}
+		__atomic_store_n(recepcao.cq_cabeca, cabeca, __ATOMIC_RELEASE);
+		
+		if(falhou){
+			printf("Recepção multishot do io_uring falhou; usando recvmmsg().\n");
+			fecha_recepcao();
+			return pkt_drop + recebe_udp(r);
+		}
+		
+		/* Os buffers já foram devolvidos; os datagramas que ficaram no
+		 * socket são lidos assim que o recebimento for rearmado. */
+		for(r_idx=0; r_idx<N_ROTEADORES; r_idx++)
+			if(!recepcao_armada[r_idx])
+				arma_recepcao(r_idx);
+		
+		/* Os datagramas que não chegaram até o limite são dados como perdidos. */
+		if(datagramas_esperados == 0 || esgotou){
+			datagramas_esperados = 0;
+			if(recepcao.pendentes)
+				syscall(__NR_io_uring_enter, recepcao.fd, recepcao.pendentes, 0, 0, NULL, 0);
+			recepcao.pendentes = 0;
+			break;
+		}
+		
+		if(syscall(__NR_io_uring_enter, recepcao.fd, recepcao.pendentes, 1,
+		           IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &espera, sizeof(espera)) < 0 && errno != EINTR)
+			esgotou = 1;
+		recepcao.pendentes = 0;
+	}
+	
+	return pkt_drop;
+}
+
+int recebe_udp(roteador * r){
+	
+	/* Sem o anel de recepção, cada socket é esvaziado com recvmmsg() em
+	 * lotes. Os datagramas que couberem no buffer de entrada do roteador
+	 * são desserializados nele; os demais são descartados e contados como
+	 * pacotes dropados. */
+	
+	uint8_t bufs[PKT_BUFFER][RIP_TAMANHO_MAXIMO];
+	struct sockaddr_in origens[PKT_BUFFER];
+	struct mmsghdr mensagens[PKT_BUFFER];
+	struct iovec iovs[PKT_BUFFER];
+	struct epoll_event eventos[N_ROTEADORES];
+	int r_idx, i, n, prontos, pronto, pkt_drop = 0;
+	
+	if(recepcao.fd >= 0)
+		return recebe_udp_anel(r);
+	
+	/* Apenas os sockets com datagramas são visitados. */
+	prontos = epoll_wait(epoll_udp, eventos, N_ROTEADORES, 0);
+	
+	for(pronto=0; pronto<prontos; pronto++){
+		
+		r_idx = eventos[pronto].data.u32;
+		
+		while(1){
+			
+			for(i=0; i<PKT_BUFFER; i++){
+				iovs[i].iov_base = bufs[i];
+				iovs[i].iov_len  = RIP_TAMANHO_MAXIMO;
+				memset(&mensagens[i], 0, sizeof(mensagens[i]));
+				mensagens[i].msg_hdr.msg_name    = &origens[i];
+				mensagens[i].msg_hdr.msg_namelen = sizeof(origens[i]);
+				mensagens[i].msg_hdr.msg_iov     = &iovs[i];
+				mensagens[i].msg_hdr.msg_iovlen  = 1;
+			}
+			
+			n = recvmmsg(sockets_udp[r_idx], mensagens, PKT_BUFFER, MSG_DONTWAIT, NULL);
+			if(n <= 0) break;
+			
+			for(i=0; i<n; i++)
+				pkt_drop += entrega_datagrama(r, r_idx, &origens[i], bufs[i], mensagens[i].msg_len);
+		}
+	}
+	
+	/* No loopback a entrega é síncrona: o que foi enviado já foi lido. */
+	datagramas_esperados = 0;
+	
+	return pkt_drop;
+}
+
+void relata_emulacao_udp(void){
+	
+	double duracao = relogio() - inicio_emulacao;
+	
+	printf("Emulação UDP (%s, %s): %ld datagramas enviados, %ld recebidos em %.2f s (%.0f datagramas/s).\n",
+		anel.fd >= 0 ? "io_uring" : "sendmmsg", recepcao.fd >= 0 ? "recvmsg multishot" : "recvmmsg",
+		datagramas_enviados, datagramas_recebidos, duracao,
+		duracao > 0 ? datagramas_recebidos / duracao : 0.0);
+	
+	if(datagramas_estranhos)
+		printf("  %ld datagramas de portas que não são de vizinhos foram descartados.\n", datagramas_estranhos);
+}
+
+void finaliza_emulacao_udp(void){
+	
+	int i;
+	
+	if(!emulacao_udp) return;
+	
+	fecha_anel(&anel);
+	fecha_recepcao();
+	
+	close(epoll_udp);
+	epoll_udp = -1;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		close(sockets_udp[i]);
+	
+	emulacao_udp = 0;
+}
+
+void gera_topologia(unsigned semente){
+	
+	/* Cada roteador (a partir do segundo) se liga a um anterior sorteado,
+	 * o que garante uma rede conexa; os demais pares se ligam com
+	 * probabilidade de 30%. Os custos de cada sentido são sorteados entre
+	 * 1 e 2, para que a maioria dos destinos fique abaixo de INFINITO. */
+	
+	int vizinhos[N_ROTEADORES];
+	int i, j, ligar;
+	
+	srandom(semente);
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES; j++)
+			custos_enlaces[i][j] = ORACULO_INF;
+	
+	for(i=1; i<N_ROTEADORES; i++){
+		
+		ligar = random() % i;
+		
+		for(j=0; j<i; j++)
+			if(j == ligar || random() % 10 < 3){
+				custos_enlaces[i][j] = 1 + random() % 2;
+				custos_enlaces[j][i] = 1 + random() % 2;
+			}
+	}
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		for(j=0; j<N_ROTEADORES; j++)
+			vizinhos[j] = -1;
+		
+		ligar = 0;
+		for(j=0; j<N_ROTEADORES; j++)
+			if(custos_enlaces[i][j] != ORACULO_INF)
+				vizinhos[ligar++] = j;
+		
+		memcpy(conexoes_enlaces[i], vizinhos, sizeof(vizinhos));
+	}
+}
+
+void tabelas_de_custos(roteador * r){
+	
+	int i, j;
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		r[i].id = i;
+		r[i].idx = 0;
+		r[i].disparo_pendente = r[i].espera_disparo = r[i].nivel_disparo = 0;
+		
+		for(j=0; j<N_ROTEADORES; j++){
+			_preencher_enlaces(r, i, j, custos_enlaces[i][j] == ORACULO_INF ? INFINITO : custos_enlaces[i][j]);
+			ultima_mudanca[i][j] = -1;
+		}
+	}
+}
+
+uint64_t hash_roteador(roteador * r, int r_idx){
+	
+	/* FNV-1a sobre o custo e o caminho de cada rota. */
+	
+	uint64_t h = 1469598103934665603ULL;
+	int j;
+	
+	for(j=0; j<N_ROTEADORES; j++){
+		h = (h ^ (uint32_t) r[r_idx].rotas[j].custo)   * 1099511628211ULL;
+		h = (h ^ (uint32_t) r[r_idx].rotas[j].caminho) * 1099511628211ULL;
+	}
+	
+	return h;
+}
+
+int executa_diferencial(int rodadas, unsigned semente){
+	
+	/* Os dois motores recebem a mesma topologia e o mesmo estado inicial e
+	 * avançam passo a passo, cada um com seu próprio gerador de números
+	 * aleatórios (iniciado com a mesma semente), para que sorteiem os
+	 * mesmos intervalos. Depois de cada passo os hashes das tabelas são
+	 * comparados. Como a comparação é feita a cada passo, a primeira
+	 * divergência é encontrada no passo exato em que ocorre; o roteador e a
+	 * rota divergentes são então identificados.
+	 * 
+	 * O registro auxiliar da última mudança de cada rota é compartilhado
+	 * pelos dois motores e não é comparado. */
+	
+	static char estado_ref[256], estado_par[256];
+	roteador * ref, * par;
+	int rodada, passo, ultimo_passo_com_variacao, drop_ref, drop_par, delta_ref, delta_par;
+	int r_idx, j, divergiu, divergencias = 0;
+	double t0, tempo_ref = 0, tempo_par = 0;
+	
+	ref = aloca_roteadores(NULL);
+	par = aloca_roteadores(NULL);
+	if(!ref || !par) return 1;
+	
+	if(n_threads == 1)
+		printf("Aviso: com 1 thread os dois motores são iguais (use -T).\n");
+	
+	/* O estado do amortecimento é global e seria compartilhado pelos motores. */
+	if(amortecimento_ativo){
+		printf("Aviso: o amortecimento (-F) não é usado na comparação.\n");
+		amortecimento_ativo = 0;
+	}
+	
+	for(rodada=0; rodada<rodadas; rodada++){
+		
+		gera_topologia(semente + rodada);
+		tabelas_de_custos(ref);
+		tabelas_de_custos(par);
+		
+		initstate(semente + rodada, estado_ref, sizeof(estado_ref));
+		for(r_idx=0; r_idx<N_ROTEADORES; r_idx++)
+			ref[r_idx].intervalo = sorteia_intervalo(1);
+		
+		initstate(semente + rodada, estado_par, sizeof(estado_par));
+		for(r_idx=0; r_idx<N_ROTEADORES; r_idx++)
+			par[r_idx].intervalo = sorteia_intervalo(1);
+		
+		passo = ultimo_passo_com_variacao = 0;
+		drop_ref = drop_par = 0;
+		divergiu = 0;
+		
+		while(1){
+			
+			passo_atual = passo;
+			
+			setstate(estado_ref);
+			seleciona_motor(0);
+			t0 = relogio();
+			delta_ref = executa_passo(ref, &drop_ref);
+			tempo_ref += relogio() - t0;
+			
+			setstate(estado_par);
+			seleciona_motor(1);
+			t0 = relogio();
+			delta_par = executa_passo(par, &drop_par);
+			tempo_par += relogio() - t0;
+			
+			for(r_idx=0; r_idx<N_ROTEADORES && !divergiu; r_idx++)
+				if(hash_roteador(ref, r_idx) != hash_roteador(par, r_idx)){
+					
+					divergiu = 1;
+					printf("Rodada %d: divergência no passo %d, roteador %s.\n", rodada, passo, nomes_roteadores[r_idx]);
+					
+					for(j=0; j<N_ROTEADORES; j++)
+						if(ref[r_idx].rotas[j].custo != par[r_idx].rotas[j].custo || ref[r_idx].rotas[j].caminho != par[r_idx].rotas[j].caminho)
+							printf("  C(%s,%s): referência %d por %d, paralelo %d por %d\n",
+								nomes_roteadores[r_idx], nomes_roteadores[j],
+								ref[r_idx].rotas[j].custo, ref[r_idx].rotas[j].caminho,
+								par[r_idx].rotas[j].custo, par[r_idx].rotas[j].caminho);
+				}
+			
+			if(!divergiu && (delta_ref != delta_par || drop_ref != drop_par)){
+				divergiu = 1;
+				printf("Rodada %d: contadores divergem no passo %d (delta %d/%d, drop %d/%d).\n",
+					rodada, passo, delta_ref, delta_par, drop_ref, drop_par);
+			}
+			
+			if(divergiu) break;
+			
+			if(delta_ref) ultimo_passo_com_variacao = passo;
+			if(passo - ultimo_passo_com_variacao >= ESTADO_ESTATICO) break;
+			
+			passo++;
+		}
+		
+		divergencias += divergiu;
+		if(!divergiu)
+			printf("Rodada %d: %d passos idênticos.\n", rodada, passo + 1);
+	}
+	
+	printf("%d de %d rodadas divergiram. Motor paralelo (%d threads): %.2fx a velocidade da referência.\n",
+		divergencias, rodadas, n_threads, tempo_par > 0 ? tempo_ref / tempo_par : 0.0);
+	
+	libera_roteadores(ref);
+	libera_roteadores(par);
+	
+	srandom(semente);
+	
+	return divergencias;
+}
+
+uint64_t hash_topologia(void){
+	
+	/* FNV-1a sobre os custos (que também descrevem os enlaces) e sobre
+	 * os parâmetros que mudam o volume de trabalho por passo. */
+	
+	uint64_t h = 1469598103934665603ULL;
+	int parametros[] = {N_ROTEADORES, INFINITO, PKT_BUFFER, N_THREADS, n_destinos,
+	                    distribuicao_intervalo, intervalo_periodo, intervalo_jitter,
+	                    disparo_ativo, disparo_espera_min, disparo_espera_max, disparo_recuo,
+	                    amortecimento_ativo};
+	const uint8_t * p;
+	size_t i;
+	
+	p = (const uint8_t *) parametros;
+	for(i=0; i<sizeof(parametros); i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	
+	p = (const uint8_t *) custos_enlaces;
+	for(i=0; i<sizeof(custos_enlaces); i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	
+	return h;
+}
+
+/* Busca em largura pelos enlaces, em saltos. Preenche "saltos" (-1 para
+ * inalcançável) e retorna o roteador mais distante da origem. */
+static int busca_saltos(int origem, int * saltos){
+	
+	int fila[N_ROTEADORES];
+	int inicio = 0, fim = 0, atual, vizinho, k;
+	
+	for(k=0; k<N_ROTEADORES; k++)
+		saltos[k] = -1;
+	
+	saltos[origem] = 0;
+	fila[fim++] = origem;
+	
+	while(inicio < fim){
+		
+		atual = fila[inicio++];
+		
+		for(k=0; k<N_ROTEADORES; k++){
+			vizinho = conexoes_enlaces[atual][k];
+			if(vizinho < 0 || saltos[vizinho] >= 0) continue;
+			saltos[vizinho] = saltos[atual] + 1;
+			fila[fim++] = vizinho;
+		}
+	}
+	
+	return fila[fim-1];
+}
+
+/* Mede o tempo de CALIBRACAO_PASSOS passos com a quantidade de threads
+ * indicada, partindo das tabelas iniciais. */
+static double calibra(roteador * r, int threads){
+	
+	double t0, melhor = -1;
+	int repeticao, passo, r_idx, pkt_drop = 0;
+	
+	n_threads = threads;
+	inicia_threads();
+	
+	for(repeticao=0; repeticao<CALIBRACAO_REPETICOES; repeticao++){
+		
+		tabelas_de_custos(r);
+		
+		srandom(1);
+		for(r_idx=0; r_idx<N_ROTEADORES; r_idx++)
+			r[r_idx].intervalo = sorteia_intervalo(1);
+		
+		t0 = relogio();
+		for(passo=0; passo<CALIBRACAO_PASSOS; passo++)
+			executa_passo(r, &pkt_drop);
+		t0 = relogio() - t0;
+		
+		if(melhor < 0 || t0 < melhor)
+			melhor = t0;
+	}
+	
+	/* Sem tempo de recebimento, finaliza_threads() não imprime a eficiência. */
+	tempo_recebimento = 0;
+	finaliza_threads();
+	
+	return melhor;
+}
+
+void autoajusta(const char * arquivo){
+	
+	/* Os candidatos são as quantidades de threads da fase de recebimento
+	 * (1 é o motor sequencial de referência). Cada um executa alguns passos
+	 * sobre uma cópia das tabelas iniciais, com o mesmo gerador de números
+	 * aleatórios, e o mais rápido é usado na simulação. A calibração não
+	 * deixa rastros: os contadores, as últimas mudanças e o estado
+	 * do gerador principal são restaurados ao final. */
+	
+	static long copia_pacotes_enlace[N_ROTEADORES][N_ROTEADORES];
+	static char estado_calibracao[256];
+	long copia_pacotes_enviados = pacotes_enviados;
+	long copia_disparos_enviados = disparos_enviados, copia_disparos_agrupados = disparos_agrupados;
+	long copia_pico_mensagens = pico_mensagens;
+	double copia_tempo_envio = tempo_envio;
+	char * estado_principal;
+	int copia_emulacao = emulacao_udp;
+	
+	uint64_t hash = hash_topologia(), hash_lido;
+	int threads_lidas, melhor_threads = 1, maximo;
+	int saltos[N_ROTEADORES];
+	int grau, grau_min = N_ROTEADORES, grau_max = 0, enlaces = 0, diametro, i, k;
+	double tempo, melhor_tempo = -1;
+	roteador * r;
+	FILE * f;
+	
+	f = fopen(arquivo, "r");
+	if(f){
+		while(fscanf(f, "%" SCNx64 " %d", &hash_lido, &threads_lidas) == 2)
+			if(hash_lido == hash){
+				fclose(f);
+				n_threads = threads_lidas;
+				printf("Perfil %016" PRIx64 " encontrado em %s: %d threads.\n", hash, arquivo, n_threads);
+				return;
+			}
+		fclose(f);
+	}
+	
+	/* Estatísticas da topologia. O diâmetro em saltos é estimado com duas
+	 * buscas: da primeira até o roteador mais distante e dele até o mais
+	 * distante dele (um limite inferior, exato em árvores). */
+	for(i=0; i<N_ROTEADORES; i++){
+		
+		grau = 0;
+		for(k=0; k<N_ROTEADORES; k++)
+			if(conexoes_enlaces[i][k] >= 0)
+				grau++;
+		
+		enlaces += grau;
+		if(grau < grau_min) grau_min = grau;
+		if(grau > grau_max) grau_max = grau;
+	}
+	
+	busca_saltos(busca_saltos(0, saltos), saltos);
+	diametro = 0;
+	for(i=0; i<N_ROTEADORES; i++)
+		if(saltos[i] > diametro)
+			diametro = saltos[i];
+	
+	printf("Topologia: %d roteadores, %d enlaces, grau %d/%.1f/%d (mín/médio/máx), diâmetro estimado %d saltos.\n",
+		N_ROTEADORES, enlaces, grau_min, (double) enlaces / N_ROTEADORES, grau_max, diametro);
+	
+	/* A cópia usa calloc() direto: libera_roteadores() desfaria um
+	 * mapeamento se as tabelas principais estiverem em arquivo (-m). */
+	r = calloc(N_ROTEADORES, sizeof(roteador));
+	if(!r){
+		perror("calloc");
+		return;
+	}
+	
+	memcpy(copia_pacotes_enlace, pacotes_enlace, sizeof(pacotes_enlace));
+	estado_principal = initstate(1, estado_calibracao, sizeof(estado_calibracao));
+	emulacao_udp = 0;
+	
+	maximo = N_THREADS < N_ROTEADORES ? N_THREADS : N_ROTEADORES;
+	for(i=1; i<=maximo; i++){
+		
+		tempo = calibra(r, i);
+		printf("Calibração: %d threads, %.3f ms por passo.\n", i, 1e3 * tempo / CALIBRACAO_PASSOS);
+		
+		if(melhor_tempo < 0 || tempo < melhor_tempo){
+			melhor_tempo = tempo;
+			melhor_threads = i;
+		}
+	}
+	
+	setstate(estado_principal);
+	emulacao_udp = copia_emulacao;
+	memcpy(pacotes_enlace, copia_pacotes_enlace, sizeof(pacotes_enlace));
+	pacotes_enviados = copia_pacotes_enviados;
+	disparos_enviados = copia_disparos_enviados;
+	disparos_agrupados = copia_disparos_agrupados;
+	pico_mensagens = copia_pico_mensagens;
+	tempo_envio = copia_tempo_envio;
+	tempo_recebimento = 0;
+	ocupacao_entradas = 0;
+	
+	for(i=0; i<N_ROTEADORES; i++){
+		roteador_alterado[i] = alterado_no_recebimento[i] = 0;
+		for(k=0; k<N_ROTEADORES; k++)
+			ultima_mudanca[i][k] = -1;
+	}
+	
+	free(r);
+	
+	n_threads = melhor_threads;
+	printf("Escolhidas %d threads.\n", n_threads);
+	
+	f = fopen(arquivo, "a");
+	if(!f){
+		perror(arquivo);
+		return;
+	}
+	fprintf(f, "%016" PRIx64 " %d\n", hash, n_threads);
+	fclose(f);
+}
+
+uint64_t chave_convergido(unsigned semente){
+	
+	/* Parte do hash usado pelos perfis e acrescenta o que muda o resultado
+	 * (e não só o desempenho): os destinos sorteados e a semente. */
+	
+	uint64_t h = hash_topologia();
+	const uint8_t * p;
+	size_t i;
+	
+	p = (const uint8_t *) destinos_amostrados;
+	for(i=0; i<sizeof(destinos_amostrados); i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	
+	p = (const uint8_t *) &semente;
+	for(i=0; i<sizeof(semente); i++)
+		h = (h ^ p[i]) * 1099511628211ULL;
+	
+	return h;
+}
+
+roteador * carrega_convergido(const char * diretorio, uint64_t chave, int * passo, long * relaxacoes){
+	
+	/* O mapeamento é privado: o que a simulação alterar depois não volta
+	 * para o cache. */
+	
+	char caminho[PATH_MAX];
+	convergido_t cab;
+	struct stat st;
+	roteador * r;
+	int fd;
+	
+	if(snprintf(caminho, sizeof(caminho), "%s/%016" PRIx64 ".vdc", diretorio, chave) >= (int) sizeof(caminho))
+		return NULL;
+	
+	fd = open(caminho, O_RDONLY);
+	if(fd < 0) return NULL;
+	
+	if(fstat(fd, &st) < 0 || read(fd, &cab, sizeof(cab)) != sizeof(cab) ||
+	   memcmp(cab.magica, CONVERGIDO_MAGICA, 4) || cab.versao != CONVERGIDO_VERSAO ||
+	   cab.n_roteadores != N_ROTEADORES || cab.tamanho_roteador != sizeof(roteador) ||
+	   cab.chave != chave || cab.pos_tabelas % getpagesize() ||
+	   cab.pos_auxiliares + sizeof(ultima_mudanca) + sizeof(pacotes_enlace) > cab.pos_tabelas ||
+	   (uint64_t) st.st_size < cab.pos_tabelas + N_ROTEADORES * sizeof(roteador) ||
+	   pread(fd, ultima_mudanca, sizeof(ultima_mudanca), cab.pos_auxiliares) != sizeof(ultima_mudanca) ||
+	   pread(fd, pacotes_enlace, sizeof(pacotes_enlace), cab.pos_auxiliares + sizeof(ultima_mudanca)) != sizeof(pacotes_enlace)){
+		fprintf(stderr, "%s: cache inválido, ignorado.\n", caminho);
+		close(fd);
+		return NULL;
+	}
+	
+	r = mmap(NULL, N_ROTEADORES * sizeof(roteador), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, cab.pos_tabelas);
+	close(fd);
+	if(r == MAP_FAILED){
+		perror(caminho);
+		return NULL;
+	}
+	
+	*passo = cab.passo;
+	*relaxacoes = cab.relaxacoes;
+	pacotes_enviados = cab.pacotes_enviados;
+	
+	printf("Estado convergido carregado de %s.\n", caminho);
+	
+	return r;
+}
+
+int salva_convergido(const char * diretorio, uint64_t chave, roteador * r, int passo, long relaxacoes){
+	
+	/* O arquivo é escrito com outro nome e renomeado no fim, para que
+	 * execuções simultâneas nunca mapeiem um cache incompleto. */
+	
+	char caminho[PATH_MAX], temporario[PATH_MAX + 12];
+	convergido_t cab;
+	long pagina = getpagesize();
+	FILE * f;
+	int ok;
+	
+	if(snprintf(caminho, sizeof(caminho), "%s/%016" PRIx64 ".vdc", diretorio, chave) >= (int) sizeof(caminho)){
+		fprintf(stderr, "%s: caminho longo demais para o cache.\n", diretorio);
+		return -1;
+	}
+	snprintf(temporario, sizeof(temporario), "%s.%d", caminho, (int) getpid());
+	
+	memset(&cab, 0, sizeof(cab));
+	memcpy(cab.magica, CONVERGIDO_MAGICA, 4);
+	cab.versao           = CONVERGIDO_VERSAO;
+	cab.n_roteadores     = N_ROTEADORES;
+	cab.tamanho_roteador = sizeof(roteador);
+	cab.chave            = chave;
+	cab.pos_auxiliares   = (sizeof(cab) + 7) & ~7u;
+	cab.pos_tabelas      = (cab.pos_auxiliares + sizeof(ultima_mudanca) + sizeof(pacotes_enlace) + pagina - 1) / pagina * pagina;
+	cab.passo            = passo;
+	cab.pacotes_enviados = pacotes_enviados;
+	cab.relaxacoes       = relaxacoes;
+	
+	f = fopen(temporario, "wb");
+	if(!f){
+		perror(temporario);
+		return -1;
+	}
+	
+	ok = fwrite(&cab, sizeof(cab), 1, f) == 1 &&
+	     fseek(f, cab.pos_auxiliares, SEEK_SET) == 0 &&
+	     fwrite(ultima_mudanca, sizeof(ultima_mudanca), 1, f) == 1 &&
+	     fwrite(pacotes_enlace, sizeof(pacotes_enlace), 1, f) == 1 &&
+	     fseek(f, cab.pos_tabelas, SEEK_SET) == 0 &&
+	     fwrite(r, sizeof(roteador), N_ROTEADORES, f) == N_ROTEADORES;
+	
+	if(fclose(f) || !ok || rename(temporario, caminho)){
+		perror(temporario);
+		unlink(temporario);
+		return -1;
+	}
+	
+	return 0;
+}
+
+void libera_convergido(roteador * r){
+	
+	munmap(r, N_ROTEADORES * sizeof(roteador));
+}
+
+int altera_enlace(roteador * r, int src, int dst, int custo){
+	
+	/* O roteador percebe a mudança no próprio enlace: a rota direta passa
+	 * a ter o novo custo (se ele era o caminho ou se ficou mais barato) e,
+	 * se o enlace caiu, as rotas que passavam por dst ficam inacessíveis.
+	 * O restante da rede descobre a mudança pelos anúncios seguintes. */
+	
+	int k, j, ativo, alteradas;
+	
+	if(custo >= INFINITO)
+		custo = ORACULO_INF;
+	ativo = custo != ORACULO_INF;
+	
+	alteradas = oraculo_altera_enlace(src, dst, custo);
+	grava_enlace_traco(src, dst, custo);
+	
+	// Atualiza a lista de vizinhos de src
+	for(k=0; k<N_ROTEADORES && conexoes_enlaces[src][k] != -1 && conexoes_enlaces[src][k] != dst; k++);
+	
+	if(ativo && k < N_ROTEADORES && conexoes_enlaces[src][k] == -1)
+		conexoes_enlaces[src][k] = dst;
+	
+	if(!ativo && k < N_ROTEADORES && conexoes_enlaces[src][k] == dst){
+		for(j=k; j<N_ROTEADORES-1; j++)
+			conexoes_enlaces[src][j] = conexoes_enlaces[src][j+1];
+		conexoes_enlaces[src][N_ROTEADORES-1] = -1;
+	}
+	
+	for(j=0; j<N_ROTEADORES; j++){
+		
+		if(j == dst){
+			if(r[src].rotas[dst].caminho != dst && !(ativo && custo < r[src].rotas[dst].custo))
+				continue;
+		}else if(ativo || r[src].rotas[j].caminho != dst)
+			continue;
+		
+		/* O amortecimento vale para os anúncios recebidos: a mudança no
+		 * próprio enlace é aplicada mesmo a uma rota suprimida, que deixa
+		 * de ser (a penalidade continua). */
+		if(rota_suprimida[src][j]){
+			rota_suprimida[src][j] = 0;
+			suprimidas_roteador[src]--;
+		}
+		
+		_preencher_enlaces(r, src, j, j == dst && ativo ? custo : INFINITO);
+		ultima_mudanca[src][j] = passo_atual;
+		roteador_alterado[src] = 1;
+		
+		if(disparo_ativo)
+			agenda_disparo(r, src);
+	}
+	
+	return alteradas;
+}
+
+int simula_ate_convergir(roteador * r, int passo, int * pkt_drop, long * relaxacoes){
+	
+	/* Mesmo critério de parada do laço principal, sem a tela. */
+	
+	int delta, suprimidas, ultimo_passo_com_variacao = passo - 1;
+	
+	while(1){
+		
+		passo_atual = passo;
+		
+		delta = executa_passo(r, pkt_drop);
+		*relaxacoes += delta;
+		
+		if(delta) ultimo_passo_com_variacao = passo;
+		
+		if(passo - ultimo_passo_com_variacao >= ESTADO_ESTATICO){
+			if(libera_suprimidas(r, &suprimidas))
+				ultimo_passo_com_variacao = passo;
+			else if(!suprimidas)
+				break;
+		}
+		
+		passo++;
+	}
+	
+	return ultimo_passo_com_variacao;
+}
+
+int roteador_do_nome(const char * nome){
+	
+	int i;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		if(!strcmp(nomes_roteadores[i], nome))
+			return i;
+	
+	return -1;
+}
+
+int le_custo(const char * texto){
+	
+	char * fim;
+	long custo;
+	
+	if(!strcmp(texto, "inf")) return INFINITO;
+	
+	/* strtol em vez de atoi: "3x" ou "abc" não viram 3 ou 0 em silêncio. */
+	errno = 0;
+	custo = strtol(texto, &fim, 10);
+	if(errno || fim == texto || *fim != '\0' || custo < 1 || custo >= INFINITO)
+		return -1;
+	
+	return (int) custo;
+}
+
+typedef struct resultado_ramo_t{
+	
+	/* Enviado pelo processo de um cenário ao processo principal. As
+	 * páginas copiadas são as falhas de página menores do filho, isto é,
+	 * as páginas compartilhadas que ele precisou duplicar para escrever. */
+	
+	int cenario;
+	int passos;
+	int divergencias;
+	int distancias_alteradas;
+	long pacotes;
+	long relaxacoes;
+	long paginas_copiadas;
+}resultado_ramo_t;
+
+/* Executa um cenário no processo filho e envia o resultado pelo pipe. */
+static void executa_ramo(roteador * r, int cenario, int a, int b, int custo, int passo, int saida){
+	
+	resultado_ramo_t res;
+	struct rusage antes, depois;
+	roteador * copia;
+	int pkt_drop = 0;
+	long pacotes_antes = pacotes_enviados;
+	
+	getrusage(RUSAGE_SELF, &antes);
+	
+	memset(&res, 0, sizeof(res));
+	res.cenario = cenario;
+	
+	/* As threads auxiliares não existem no filho. Os sockets, o epoll e o
+	 * anel são compartilhados com o processo principal e os outros ramos,
+	 * então o filho troca os pacotes em memória. */
+	seleciona_motor(0);
+	finaliza_emulacao_udp();
+	
+	/* Com -m as tabelas estão em um mapeamento compartilhado do arquivo,
+	 * que o fork() não duplica: o ramo escreveria nas tabelas do processo
+	 * principal e dos outros ramos. Ele passa a usar uma cópia privada. */
+	if(tabelas_mapeadas){
+		copia = malloc(N_ROTEADORES * sizeof(roteador));
+		if(!copia)
+			_exit(1);
+		memcpy(copia, r, N_ROTEADORES * sizeof(roteador));
+		r = copia;
+	}
+	
+	passo_atual = passo;
+	res.distancias_alteradas  = altera_enlace(r, a, b, custo);
+	res.distancias_alteradas += altera_enlace(r, b, a, custo);
+	
+	res.passos = simula_ate_convergir(r, passo, &pkt_drop, &res.relaxacoes) - passo + 1;
+	res.pacotes = pacotes_enviados - pacotes_antes;
+	res.divergencias = verifica_rotas(r);
+	
+	getrusage(RUSAGE_SELF, &depois);
+	res.paginas_copiadas = depois.ru_minflt - antes.ru_minflt;
+	
+	fflush(stdout);
+	if(write(saida, &res, sizeof(res)) != sizeof(res))
+		_exit(1);
+	_exit(0);
+}
+
+int ramifica_cenarios(roteador * r, const char * arquivo, int passo){
+	
+	/* Cada cenário roda em um processo criado por fork() a partir do estado
+	 * convergido. O sistema compartilha as páginas entre os processos e só
+	 * duplica as que um cenário escrever, então o custo de cada ramo é
+	 * proporcional ao que ele altera. Até RAMOS_SIMULTANEOS ramos executam
+	 * ao mesmo tempo; os resultados (menores que PIPE_BUF, portanto
+	 * escritos de uma vez) chegam por um único pipe, que é esvaziado a
+	 * cada ramo terminado para que nunca encha com um filho bloqueado na
+	 * escrita enquanto o pai o espera.
+	 * 
+	 * Formato: uma alteração de enlace por linha, "A B custo", aplicada
+	 * nos dois sentidos. "inf" ou custos a partir de INFINITO derrubam o
+	 * enlace. Linhas vazias ou iniciadas por '#' são ignoradas. */
+	
+	resultado_ramo_t * resultados = NULL, res;
+	char linha[256], nome_a[64], nome_b[64], custo_texto[32];
+	int canal[2];
+	int n = 0, capacidade = 0, ativos = 0, falhas = 0, a, b, custo, i, num_linha = 0;
+	FILE * f;
+	
+	f = fopen(arquivo, "r");
+	if(!f){
+		perror(arquivo);
+		return -1;
+	}
+	
+	if(pipe(canal) < 0){
+		perror("pipe");
+		fclose(f);
+		return -1;
+	}
+	fcntl(canal[0], F_SETFL, O_NONBLOCK);
+	
+	fflush(stdout);
+	
+	while(fgets(linha, sizeof(linha), f)){
+		
+		num_linha++;
+		if(sscanf(linha, "%63s", nome_a) != 1 || nome_a[0] == '#') continue;
+		
+		if(sscanf(linha, "%63s %63s %31s", nome_a, nome_b, custo_texto) != 3 ||
+		   (a = roteador_do_nome(nome_a)) < 0 || (b = roteador_do_nome(nome_b)) < 0 || a == b ||
+		   (custo = le_custo(custo_texto)) < 0){
+			fprintf(stderr, "%s:%d: cenário inválido\n", arquivo, num_linha);
+			continue;
+		}
+		
+		if(n == capacidade){
+			capacidade = capacidade ? 2 * capacidade : 16;
+			resultados = realloc(resultados, capacidade * sizeof(resultado_ramo_t));
+			memset(resultados + n, 0, (capacidade - n) * sizeof(resultado_ramo_t));
+		}
+		
+		if(ativos == RAMOS_SIMULTANEOS){
+			wait(NULL);
+			ativos--;
+			while(read(canal[0], &res, sizeof(res)) == sizeof(res))
+				resultados[res.cenario] = res;
+		}
+		
+		switch(fork()){
+			case -1:
+				perror("fork");
+				continue;
+			case 0:
+				close(canal[0]);
+				executa_ramo(r, n, a, b, custo, passo, canal[1]);
+		}
+		
+		ativos++;
+		n++;
+	}
+	
+	fclose(f);
+	close(canal[1]);
+	
+	/* Sem a ponta de escrita do pai, a leitura termina quando todos os
+	 * filhos tiverem saído, mesmo os que falharem antes de escrever. */
+	fcntl(canal[0], F_SETFL, 0);
+	while(read(canal[0], &res, sizeof(res)) == sizeof(res))
+		resultados[res.cenario] = res;
+	close(canal[0]);
+	
+	while(wait(NULL) > 0);
+	
+	printf("\nCenários (%d):\n", n);
+	for(i=0; i<n; i++){
+		
+		printf("  %3d: reconvergência em %d passos, %ld pacotes, %ld mudanças, %d distâncias alteradas, %ld páginas copiadas%s\n",
+			i, resultados[i].passos, resultados[i].pacotes, resultados[i].relaxacoes,
+			resultados[i].distancias_alteradas, resultados[i].paginas_copiadas,
+			resultados[i].divergencias ? ", DIVERGE da referência" : "");
+		
+		if(resultados[i].divergencias) falhas++;
+	}
+	
+	free(resultados);
+	
+	return falhas;
+}
+
+/* Traço em gravação e posições dos quadros-chave já gravados. */
+static FILE * traco = NULL;
+static int64_t * indice_quadros = NULL;
+static int n_quadros = 0;
+
+/* Grava um quadro-chave com as tabelas inteiras. */
+static void grava_quadro_traco(roteador * r, int passo){
+	
+	registro_traco_t reg = {TRACO_QUADRO, passo, 0, 0, 0, 0};
+	int32_t rota[2];
+	int i, j;
+	
+	indice_quadros = realloc(indice_quadros, 2 * (n_quadros + 1) * sizeof(int64_t));
+	indice_quadros[2*n_quadros]     = passo;
+	indice_quadros[2*n_quadros + 1] = ftello(traco);
+	n_quadros++;
+	
+	fwrite(&reg, sizeof(reg), 1, traco);
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES; j++){
+			rota[0] = r[i].rotas[j].custo;
+			rota[1] = r[i].rotas[j].caminho;
+			fwrite(rota, sizeof(rota), 1, traco);
+		}
+}
+
+int abre_traco(const char * arquivo, roteador * r){
+	
+	traco_cabecalho_t cab;
+	
+	traco = fopen(arquivo, "wb");
+	if(!traco){
+		perror(arquivo);
+		return -1;
+	}
+	
+	memset(&cab, 0, sizeof(cab));
+	fwrite(&cab, sizeof(cab), 1, traco);
+	
+	grava_quadro_traco(r, -1);
+	
+	return 0;
+}
+
+void grava_passo_traco(roteador * r, int passo){
+	
+	/* As rotas alteradas são as marcadas em ultima_mudanca com o passo
+	 * atual, tanto pelo recebimento quanto por alterações de enlace. Só o
+	 * valor no fim do passo é gravado. */
+	
+	registro_traco_t reg = {TRACO_ROTA, passo, 0, 0, 0, 0};
+	int i, j;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES; j++)
+			if(ultima_mudanca[i][j] == passo){
+				reg.a = i;
+				reg.b = j;
+				reg.c = r[i].rotas[j].custo;
+				reg.d = r[i].rotas[j].caminho;
+				fwrite(&reg, sizeof(reg), 1, traco);
+			}
+	
+	if((passo + 1) % INTERVALO_QUADROS == 0)
+		grava_quadro_traco(r, passo);
+}
+
+void grava_enlace_traco(int src, int dst, int custo){
+	
+	registro_traco_t reg = {TRACO_ENLACE, passo_atual, src, dst, custo, 0};
+	
+	if(traco)
+		fwrite(&reg, sizeof(reg), 1, traco);
+}
+
+void fecha_traco(roteador * r, int ultimo_passo){
+	
+	traco_cabecalho_t cab;
+	int i;
+	
+	/* O quadro final permite conferir o fim do traço com as tabelas
+	 * finais sem depender de nenhuma alteração gravada. */
+	if((ultimo_passo + 1) % INTERVALO_QUADROS != 0)
+		grava_quadro_traco(r, ultimo_passo);
+	
+	memset(&cab, 0, sizeof(cab));
+	memcpy(cab.magica, TRACO_MAGICA, 4);
+	cab.versao            = TRACO_VERSAO;
+	cab.n_roteadores      = N_ROTEADORES;
+	cab.intervalo_quadros = INTERVALO_QUADROS;
+	cab.ultimo_passo      = ultimo_passo;
+	cab.n_quadros         = n_quadros;
+	
+	cab.pos_indice = ftello(traco);
+	fwrite(indice_quadros, 2 * sizeof(int64_t), n_quadros, traco);
+	
+	cab.pos_nomes = ftello(traco);
+	for(i=0; i<N_ROTEADORES; i++)
+		fwrite(nomes_roteadores[i], 1, strlen(nomes_roteadores[i]) + 1, traco);
+	
+	fseeko(traco, 0, SEEK_SET);
+	fwrite(&cab, sizeof(cab), 1, traco);
+	
+	fclose(traco);
+	traco = NULL;
+	free(indice_quadros);
+	indice_quadros = NULL;
+	n_quadros = 0;
+}
+
+/* Estado do depurador: o traço mapeado, as tabelas no passo atual e um
+ * índice das alterações de cada rota (em ordem de passo). */
+static const uint8_t * depuracao_base;
+static const traco_cabecalho_t * depuracao_cab;
+static const int64_t * depuracao_quadros;
+static int32_t depuracao_rotas[N_ROTEADORES][N_ROTEADORES][2];
+static const registro_traco_t ** alteracoes_rota;	// alterações agrupadas por rota
+static int * inicio_rota;							// início de cada rota em alteracoes_rota (CSR)
+static const registro_traco_t ** eventos_enlace;
+static int n_eventos_enlace;
+
+/* Retorna o tamanho de um registro, incluindo as tabelas de um quadro. */
+static size_t tamanho_registro_traco(const registro_traco_t * reg){
+	
+	if(reg->tipo == TRACO_QUADRO)
+		return sizeof(*reg) + N_ROTEADORES * N_ROTEADORES * 2 * sizeof(int32_t);
+	return sizeof(*reg);
+}
+
+/* Reconstrói as tabelas no fim do passo indicado: parte do último
+ * quadro-chave até ele (busca binária) e aplica as alterações seguintes,
+ * que são no máximo as de intervalo_quadros passos. */
+static void depuracao_vai_para(int passo){
+	
+	const registro_traco_t * reg;
+	int64_t pos;
+	int ini = 0, fim = depuracao_cab->n_quadros - 1, meio;
+	
+	while(ini < fim){
+		meio = (ini + fim + 1) / 2;
+		if(depuracao_quadros[2*meio] <= passo) ini = meio;
+		else fim = meio - 1;
+	}
+	
+	pos = depuracao_quadros[2*ini + 1];
+	reg = (const registro_traco_t *)(depuracao_base + pos);
+	memcpy(depuracao_rotas, reg + 1, sizeof(depuracao_rotas));
+	
+	for(pos += tamanho_registro_traco(reg); pos < (int64_t) depuracao_cab->pos_indice; pos += tamanho_registro_traco(reg)){
+		
+		reg = (const registro_traco_t *)(depuracao_base + pos);
+		if(reg->passo > passo) break;
+		
+		if(reg->tipo == TRACO_ROTA){
+			depuracao_rotas[reg->a][reg->b][0] = reg->c;
+			depuracao_rotas[reg->a][reg->b][1] = reg->d;
+		}
+	}
+}
+
+/* Imprime os roteadores cujo caminho até "destino" passa por "no". */
+static void depuracao_arvore(int destino, int no, int nivel, char * visitado){
+	
+	int i;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		if(i != destino && !visitado[i] && depuracao_rotas[i][destino][1] == no){
+			visitado[i] = 1;
+			printf("%*s%s (%d)\n", 2*nivel, "", nomes_roteadores[i], depuracao_rotas[i][destino][0]);
+			depuracao_arvore(destino, i, nivel + 1, visitado);
+		}
+}
+
+/* Responde quando a rota (origem, destino) mudou pela última vez até o passo. */
+static void depuracao_quando(int origem, int destino, int passo){
+	
+	/* Busca binária na lista de alterações da rota. O valor anterior vem
+	 * da alteração anterior ou, se não houver, do quadro inicial. */
+	
+	const registro_traco_t ** lista = alteracoes_rota + inicio_rota[origem*N_ROTEADORES + destino];
+	int n = inicio_rota[origem*N_ROTEADORES + destino + 1] - inicio_rota[origem*N_ROTEADORES + destino];
+	int ini = 0, fim = n, meio, k;
+	int custo_antigo, caminho_antigo;
+	const registro_traco_t * reg, * quadro_inicial;
+	
+	while(ini < fim){
+		meio = (ini + fim) / 2;
+		if(lista[meio]->passo <= passo) ini = meio + 1;
+		else fim = meio;
+	}
+	
+	if(ini == 0){
+		printf("C(%s,%s) não mudou até o passo %d.\n", nomes_roteadores[origem], nomes_roteadores[destino], passo);
+		return;
+	}
+	
+	reg = lista[ini-1];
+	if(ini >= 2){
+		custo_antigo   = lista[ini-2]->c;
+		caminho_antigo = lista[ini-2]->d;
+	}else{
+		quadro_inicial = (const registro_traco_t *)(depuracao_base + depuracao_quadros[1]);
+		custo_antigo   = ((const int32_t *)(quadro_inicial + 1))[2*(origem*N_ROTEADORES + destino)];
+		caminho_antigo = ((const int32_t *)(quadro_inicial + 1))[2*(origem*N_ROTEADORES + destino) + 1];
+	}
+	
+	printf("C(%s,%s) mudou por último no passo %d: %d por %s -> %d por %s.\n",
+		nomes_roteadores[origem], nomes_roteadores[destino], reg->passo,
+		custo_antigo, caminho_antigo < 0 ? "-" : nomes_roteadores[caminho_antigo],
+		reg->c, reg->d < 0 ? "-" : nomes_roteadores[reg->d]);
+	
+	for(k=0; k<n_eventos_enlace; k++)
+		if(eventos_enlace[k]->passo == reg->passo && eventos_enlace[k]->a == origem){
+			printf("Motivo: alteração do enlace %s-%s (custo %d).\n", nomes_roteadores[origem],
+				nomes_roteadores[eventos_enlace[k]->b], eventos_enlace[k]->c);
+			return;
+		}
+	
+	if(reg->d >= 0)
+		printf("Motivo: anúncio de %s.\n", nomes_roteadores[reg->d]);
+	else if(caminho_antigo >= 0)
+		printf("Motivo: anúncio de %s (o caminho anterior) tornou o destino inacessível.\n", nomes_roteadores[caminho_antigo]);
+}
+
+/* Libera o mapeamento e informa o erro de depura_traco(). */
+static int traco_invalido(const char * arquivo, size_t tamanho, const char * motivo, int64_t pos){
+	
+	if(pos >= 0)
+		fprintf(stderr, "%s: %s (posição %lld)\n", arquivo, motivo, (long long) pos);
+	else
+		fprintf(stderr, "%s: %s\n", arquivo, motivo);
+	munmap((void *) depuracao_base, tamanho);
+	
+	return -1;
+}
+
+int depura_traco(const char * arquivo){
+	
+	/* Comandos (um por linha):
+	 *   passo N         vai para o fim do passo N (-1 é o estado inicial)
+	 *   + [n], - [n]    avança ou volta n passos (1 se omitido)
+	 *   tabela A        mostra a tabela do roteador A
+	 *   arvore F        mostra a árvore de próximos saltos até o destino F
+	 *   quando A F      quando e por que a rota de A até F mudou por último
+	 *   sair
+	 * 
+	 * O arquivo pode vir de qualquer lugar, então tudo é conferido antes
+	 * de ser usado, como em carrega_topologia(): os registros precisam
+	 * terminar exatamente no índice e citar só roteadores existentes, os
+	 * quadros-chave precisam ser, em ordem, os apontados pelo índice, e os
+	 * nomes precisam terminar dentro do arquivo. */
+	
+	struct stat info;
+	const registro_traco_t * reg;
+	const int32_t * rotas;
+	const char * nome;
+	char linha[256], comando[32], nome_a[64], nome_b[64];
+	char visitado[N_ROTEADORES];
+	int64_t pos, pos_indice;
+	uint32_t k;
+	int * preenchidos;
+	int passo = -1, n, a, b, i, fd;
+	
+	fd = open(arquivo, O_RDONLY);
+	if(fd < 0 || fstat(fd, &info) < 0){
+		perror(arquivo);
+		if(fd >= 0) close(fd);
+		return -1;
+	}
+	
+	depuracao_base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(depuracao_base == MAP_FAILED){
+		perror(arquivo);
+		return -1;
+	}
+	
+	depuracao_cab = (const traco_cabecalho_t *) depuracao_base;
+	if(info.st_size < (off_t) sizeof(traco_cabecalho_t) || memcmp(depuracao_cab->magica, TRACO_MAGICA, 4) ||
+	   depuracao_cab->versao != TRACO_VERSAO)
+		return traco_invalido(arquivo, info.st_size, "não é um traço válido (ou não foi fechado)", -1);
+	
+	if(depuracao_cab->n_roteadores != N_ROTEADORES){
+		fprintf(stderr, "%s: o traço tem %u roteadores, mas o simulador foi compilado para %d\n", arquivo, depuracao_cab->n_roteadores, N_ROTEADORES);
+		munmap((void *) depuracao_base, info.st_size);
+		return -1;
+	}
+	
+	/* O índice vem logo depois dos registros e os nomes logo depois do
+	 * índice. As contas são feitas sem somas que possam dar a volta. */
+	if(depuracao_cab->n_quadros == 0 || depuracao_cab->pos_indice % 8 ||
+	   depuracao_cab->pos_indice < sizeof(traco_cabecalho_t) ||
+	   depuracao_cab->pos_indice > (uint64_t) info.st_size ||
+	   depuracao_cab->n_quadros > (info.st_size - depuracao_cab->pos_indice) / (2 * sizeof(int64_t)) ||
+	   depuracao_cab->pos_nomes != depuracao_cab->pos_indice + depuracao_cab->n_quadros * 2 * sizeof(int64_t) ||
+	   depuracao_cab->pos_nomes >= (uint64_t) info.st_size)
+		return traco_invalido(arquivo, info.st_size, "seções do traço inconsistentes", -1);
+	
+	pos_indice = depuracao_cab->pos_indice;
+	depuracao_quadros = (const int64_t *)(depuracao_base + pos_indice);
+	
+	for(pos = sizeof(traco_cabecalho_t), k = 0; pos < pos_indice; pos += tamanho_registro_traco(reg)){
+		
+		reg = (const registro_traco_t *)(depuracao_base + pos);
+		if(pos_indice - pos < (int64_t) sizeof(*reg) || reg->tipo < TRACO_ROTA || reg->tipo > TRACO_QUADRO ||
+		   pos_indice - pos < (int64_t) tamanho_registro_traco(reg))
+			return traco_invalido(arquivo, info.st_size, "registro inválido ou além do índice", pos);
+		
+		if(reg->tipo == TRACO_QUADRO){
+			
+			if(k >= depuracao_cab->n_quadros || depuracao_quadros[2*k + 1] != pos || depuracao_quadros[2*k] != reg->passo ||
+			   (k > 0 && depuracao_quadros[2*k] < depuracao_quadros[2*k - 2]))
+				return traco_invalido(arquivo, info.st_size, "quadro-chave fora do índice", pos);
+			k++;
+			
+			rotas = (const int32_t *)(reg + 1);
+			for(i=0; i<N_ROTEADORES * N_ROTEADORES; i++)
+				if(rotas[2*i + 1] < -1 || rotas[2*i + 1] >= N_ROTEADORES)
+					return traco_invalido(arquivo, info.st_size, "caminho inexistente em um quadro-chave", pos);
+			
+		}else if(reg->a < 0 || reg->a >= N_ROTEADORES || reg->b < 0 || reg->b >= N_ROTEADORES ||
+		         (reg->tipo == TRACO_ROTA && (reg->d < -1 || reg->d >= N_ROTEADORES)))
+			return traco_invalido(arquivo, info.st_size, "roteador inexistente em um registro", pos);
+	}
+	
+	if(k != depuracao_cab->n_quadros)
+		return traco_invalido(arquivo, info.st_size, "índice de quadros-chave inconsistente", -1);
+	
+	nome = (const char *)(depuracao_base + depuracao_cab->pos_nomes);
+	for(i=0; i<N_ROTEADORES; i++){
+		if(!memchr(nome, '\0', (const char *) depuracao_base + info.st_size - nome))
+			return traco_invalido(arquivo, info.st_size, "nome fora do arquivo", -1);
+		nome += strlen(nome) + 1;
+		if(i < N_ROTEADORES - 1 && nome >= (const char *) depuracao_base + info.st_size)
+			return traco_invalido(arquivo, info.st_size, "nome fora do arquivo", -1);
+	}
+	
+	nome = (const char *)(depuracao_base + depuracao_cab->pos_nomes);
+	for(i=0; i<N_ROTEADORES; i++){
+		nomes_roteadores[i] = (char *) nome;
+		nome += strlen(nome) + 1;
+	}
+	
+	/* Índice das alterações por rota: uma passada conta, outra preenche. */
+	inicio_rota = calloc(N_ROTEADORES * N_ROTEADORES + 1, sizeof(int));
+	preenchidos = calloc(N_ROTEADORES * N_ROTEADORES, sizeof(int));
+	n_eventos_enlace = 0;
+	
+	for(pos = sizeof(traco_cabecalho_t); pos < (int64_t) depuracao_cab->pos_indice; pos += tamanho_registro_traco(reg)){
+		reg = (const registro_traco_t *)(depuracao_base + pos);
+		if(reg->tipo == TRACO_ROTA) inicio_rota[reg->a*N_ROTEADORES + reg->b + 1]++;
+		if(reg->tipo == TRACO_ENLACE) n_eventos_enlace++;
+	}
+	
+	for(i=0; i<N_ROTEADORES * N_ROTEADORES; i++)
+		inicio_rota[i+1] += inicio_rota[i];
+	
+	alteracoes_rota = malloc((inicio_rota[N_ROTEADORES * N_ROTEADORES] + 1) * sizeof(registro_traco_t *));
+	eventos_enlace = malloc((n_eventos_enlace + 1) * sizeof(registro_traco_t *));
+	n_eventos_enlace = 0;
+	
+	for(pos = sizeof(traco_cabecalho_t); pos < (int64_t) depuracao_cab->pos_indice; pos += tamanho_registro_traco(reg)){
+		reg = (const registro_traco_t *)(depuracao_base + pos);
+		if(reg->tipo == TRACO_ROTA){
+			i = reg->a*N_ROTEADORES + reg->b;
+			alteracoes_rota[inicio_rota[i] + preenchidos[i]++] = reg;
+		}
+		if(reg->tipo == TRACO_ENLACE)
+			eventos_enlace[n_eventos_enlace++] = reg;
+	}
+	
+	free(preenchidos);
+	
+	printf("Traço %s: passos -1 a %d, %d alterações de rotas, %u quadros-chave a cada %u passos.\n",
+		arquivo, depuracao_cab->ultimo_passo, inicio_rota[N_ROTEADORES * N_ROTEADORES],
+		depuracao_cab->n_quadros, depuracao_cab->intervalo_quadros);
+	printf("Comandos: passo N, + [n], - [n], tabela A, arvore F, quando A F, sair\n");
+	
+	depuracao_vai_para(passo);
+	
+	while(printf("(passo %d) ", passo), fflush(stdout), fgets(linha, sizeof(linha), stdin)){
+		
+		n = sscanf(linha, "%31s %63s %63s", comando, nome_a, nome_b);
+		if(n < 1) continue;
+		
+		if(!strcmp(comando, "sair")) break;
+		
+		if(!strcmp(comando, "passo") || !strcmp(comando, "+") || !strcmp(comando, "-")){
+			
+			i = n >= 2 ? atoi(nome_a) : 1;
+			if(comando[0] == '+') passo += i;
+			else if(comando[0] == '-') passo -= i;
+			else if(n >= 2) passo = i;
+			
+			if(passo < -1) passo = -1;
+			if(passo > depuracao_cab->ultimo_passo) passo = depuracao_cab->ultimo_passo;
+			
+			depuracao_vai_para(passo);
+			continue;
+		}
+		
+		a = n >= 2 ? roteador_do_nome(nome_a) : -1;
+		b = n >= 3 ? roteador_do_nome(nome_b) : -1;
+		
+		if(!strcmp(comando, "tabela") && a >= 0){
+			for(i=0; i<N_ROTEADORES; i++)
+				if(i != a){
+					if(depuracao_rotas[a][i][0] >= INFINITO || depuracao_rotas[a][i][1] < 0)
+						printf("C(%s,%s)=INF\n", nomes_roteadores[a], nomes_roteadores[i]);
+					else
+						printf("C(%s,%s)=%d por %s\n", nomes_roteadores[a], nomes_roteadores[i],
+							depuracao_rotas[a][i][0], nomes_roteadores[depuracao_rotas[a][i][1]]);
+				}
+		}else if(!strcmp(comando, "arvore") && a >= 0){
+			
+			/* Quem não aparece na árvore não tem rota ou está em um laço. */
+			memset(visitado, 0, sizeof(visitado));
+			printf("%s\n", nomes_roteadores[a]);
+			depuracao_arvore(a, a, 1, visitado);
+			
+			for(i=0; i<N_ROTEADORES; i++)
+				if(i != a && !visitado[i])
+					printf("%s: %s\n", nomes_roteadores[i], depuracao_rotas[i][a][1] < 0 ? "sem rota" : "em laço");
+		}else if(!strcmp(comando, "quando") && a >= 0 && b >= 0){
+			depuracao_quando(a, b, passo);
+		}else
+			printf("Comando desconhecido ou roteador inexistente.\n");
+	}
+	
+	free(inicio_rota);
+	free(alteracoes_rota);
+	free(eventos_enlace);
+	munmap((void *) depuracao_base, info.st_size);
+	
+	return 0;
+}
+
+/* Linha do tempo do roteiro como foi lida (os nomes só podem ser
+ * resolvidos depois que a topologia é carregada). */
+typedef struct linha_roteiro_t{
+	
+	int linha;
+	int passo;
+	int fim;				// último passo de uma janela
+	char tipo[16];			// "enlace", "roteador" ou "janela"
+	char a[64], b[64];
+	char valor[16];			// custo ou "inf"; "liga" ou "desliga"
+}linha_roteiro_t;
+
+typedef struct janela_t{
+	
+	int inicio, fim;
+	long pacotes, relaxacoes, descartes;
+}janela_t;
+
+static const char * arquivo_do_roteiro;
+static linha_roteiro_t * linhas_roteiro = NULL;
+static int n_linhas_roteiro = 0;
+
+static evento_t eventos[MAX_EVENTOS];
+static int n_eventos = 0, proximo_evento = 0;
+static janela_t janelas[MAX_JANELAS];
+static int n_janelas = 0;
+
+/* Afirmações do roteiro (-1 quando ausentes). */
+static int afirma_converge = -1, afirma_confere = 0;
+static long afirma_pacotes = -1;
+
+/* Medidas: relaxações acumuladas e o grupo de eventos em reconvergência. */
+static long relaxacoes_roteiro = 0;
+static int inicio_reconvergencia = 0, ultima_variacao_roteiro = -1, pior_reconvergencia = 0;
+
+int le_roteiro(const char * arquivo){
+	
+	/* Formato (uma diretiva por linha; '#' inicia um comentário):
+	 * 
+	 *   topologia arquivo.bin            topologia binária (sem ela, o diagrama com custo 1)
+	 *   semente N
+	 *   intervalo fixo|uniforme|exponencial|periodico [periodo [jitter]]
+	 *                                    periodo a partir de 1, jitter de 0 a 100 (%)
+	 *   em P enlace A B custo|inf        altera o enlace A-B nos dois sentidos no passo P
+	 *   em P roteador A desliga|liga     derruba ou restaura todos os enlaces de A
+	 *   janela P1 P2                     mede pacotes, mudanças e descartes de P1 a P2
+	 *   converge N                       cada evento (e o início) converge em até N passos
+	 *   confere                          as tabelas finais conferem com a referência
+	 *   pacotes N                        no máximo N pacotes enviados no total
+	 *   disparo min max [recuo]          atualizações disparadas (como -A e -B)
+	 *   amortecimento                    amortece rotas que oscilam (como -F) */
+	
+	static const char * distribuicoes[] = {"fixo", "uniforme", "exponencial", "periodico"};
+	char texto[256], diretiva[32], * comentario;
+	linha_roteiro_t l;
+	FILE * f;
+	int num_linha = 0, i, erro = 0;
+	
+	f = fopen(arquivo, "r");
+	if(!f){
+		perror(arquivo);
+		return -1;
+	}
+	
+	arquivo_do_roteiro = arquivo;
+	
+	while(fgets(texto, sizeof(texto), f)){
+		
+		num_linha++;
+		if((comentario = strchr(texto, '#'))) *comentario = '\0';
+		if(sscanf(texto, "%31s", diretiva) != 1) continue;
+		
+		memset(&l, 0, sizeof(l));
+		l.linha = num_linha;
+		
+		if(!strcmp(diretiva, "topologia")){
+			if(sscanf(texto, "%*s %63s", l.a) != 1) goto invalida;
+			roteiro_topologia = strdup(l.a);
+		}else if(!strcmp(diretiva, "semente")){
+			if(sscanf(texto, "%*s %ld", &roteiro_semente) != 1) goto invalida;
+		}else if(!strcmp(diretiva, "intervalo")){
+			if(sscanf(texto, "%*s %15s %d %d", l.valor, &intervalo_periodo, &intervalo_jitter) < 1 ||
+			   intervalo_periodo < 1 || intervalo_jitter < 0 || intervalo_jitter > 100)
+				goto invalida;
+			for(i=0; i<4 && strcmp(l.valor, distribuicoes[i]); i++);
+			if(i == 4) goto invalida;
+			distribuicao_intervalo = i;
+		}else if(!strcmp(diretiva, "converge")){
+			if(sscanf(texto, "%*s %d", &afirma_converge) != 1) goto invalida;
+		}else if(!strcmp(diretiva, "pacotes")){
+			if(sscanf(texto, "%*s %ld", &afirma_pacotes) != 1) goto invalida;
+		}else if(!strcmp(diretiva, "confere")){
+			afirma_confere = 1;
+		}else if(!strcmp(diretiva, "amortecimento")){
+			amortecimento_ativo = 1;
+		}else if(!strcmp(diretiva, "disparo")){
+			if(sscanf(texto, "%*s %d %d %15s", &disparo_espera_min, &disparo_espera_max, l.valor) < 2 ||
+			   disparo_espera_min < 0 || disparo_espera_max < disparo_espera_min ||
+			   (l.valor[0] && strcmp(l.valor, "recuo")))
+				goto invalida;
+			disparo_ativo = 1;
+			disparo_recuo = l.valor[0] != '\0';
+		}else if(!strcmp(diretiva, "janela")){
+			if(sscanf(texto, "%*s %d %d", &l.passo, &l.fim) != 2 || l.passo < 0 || l.fim < l.passo) goto invalida;
+			strcpy(l.tipo, "janela");
+			goto guarda;
+		}else if(!strcmp(diretiva, "em")){
+			if(sscanf(texto, "%*s %d %15s", &l.passo, l.tipo) != 2 || l.passo < 0) goto invalida;
+			if(!strcmp(l.tipo, "enlace") && sscanf(texto, "%*s %*d %*s %63s %63s %15s", l.a, l.b, l.valor) == 3){
+				if(le_custo(l.valor) < 0){
+					fprintf(stderr, "%s:%d: custo inválido \"%s\" (use inf ou 1 a %d)\n",
+						arquivo, num_linha, l.valor, INFINITO - 1);
+					erro = 1;
+					continue;
+				}
+				goto guarda;
+			}
+			if(!strcmp(l.tipo, "roteador") && sscanf(texto, "%*s %*d %*s %63s %15s", l.a, l.valor) == 2 &&
+			   (!strcmp(l.valor, "liga") || !strcmp(l.valor, "desliga")))
+				goto guarda;
+			goto invalida;
+		}else
+			goto invalida;
+		
+		continue;
+		
+	guarda:
+		linhas_roteiro = realloc(linhas_roteiro, (n_linhas_roteiro + 1) * sizeof(linha_roteiro_t));
+		linhas_roteiro[n_linhas_roteiro++] = l;
+		continue;
+		
+	invalida:
+		fprintf(stderr, "%s:%d: diretiva inválida\n", arquivo, num_linha);
+		erro = 1;
+	}
+	
+	fclose(f);
+	
+	return erro ? -1 : 0;
+}
+
+/* Acrescenta um evento ao vetor. Retorna -1 se não houver espaço. */
+static int acrescenta_evento(int passo, int tipo, int a, int b, int custo){
+	
+	if(n_eventos == MAX_EVENTOS){
+		fprintf(stderr, "%s: mais de %d eventos\n", arquivo_do_roteiro, MAX_EVENTOS);
+		return -1;
+	}
+	
+	eventos[n_eventos].passo = passo;
+	eventos[n_eventos].tipo  = tipo;
+	eventos[n_eventos].a     = a;
+	eventos[n_eventos].b     = b;
+	eventos[n_eventos].custo = custo;
+	n_eventos++;
+	
+	return 0;
+}
+
+int compila_roteiro(void){
+	
+	/* Cada linha vira eventos de enlace em um único sentido: um enlace
+	 * gera dois, e um roteador gera dois por vizinho da topologia
+	 * original (desligar derruba, ligar restaura os custos originais).
+	 * Depois os eventos são ordenados por passo, mantendo a ordem do
+	 * arquivo entre eventos do mesmo passo (ordenação por inserção, que é
+	 * estável e rápida para linhas do tempo quase ordenadas). */
+	
+	static int custos_originais[N_ROTEADORES][N_ROTEADORES];
+	linha_roteiro_t * l;
+	evento_t e;
+	int i, j, a, b, custo, erro = 0;
+	
+	memcpy(custos_originais, custos_enlaces, sizeof(custos_originais));
+	
+	for(i=0; i<n_linhas_roteiro && !erro; i++){
+		
+		l = &linhas_roteiro[i];
+		
+		if(!strcmp(l->tipo, "janela")){
+			if(n_janelas == MAX_JANELAS){
+				fprintf(stderr, "%s: mais de %d janelas\n", arquivo_do_roteiro, MAX_JANELAS);
+				return -1;
+			}
+			janelas[n_janelas].inicio = l->passo;
+			janelas[n_janelas].fim    = l->fim;
+			erro |= acrescenta_evento(l->passo, EVENTO_JANELA_INICIO, n_janelas, 0, 0);
+			erro |= acrescenta_evento(l->fim + 1, EVENTO_JANELA_FIM, n_janelas, 0, 0);
+			n_janelas++;
+			continue;
+		}
+		
+		a = roteador_do_nome(l->a);
+		b = !strcmp(l->tipo, "enlace") ? roteador_do_nome(l->b) : 0;
+		if(a < 0 || b < 0 || (!strcmp(l->tipo, "enlace") && a == b)){
+			fprintf(stderr, "%s:%d: roteador inexistente\n", arquivo_do_roteiro, l->linha);
+			return -1;
+		}
+		
+		if(!strcmp(l->tipo, "enlace")){
+			custo = le_custo(l->valor);
+			erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, a, b, custo);
+			erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, b, a, custo);
+			continue;
+		}
+		
+		for(j=0; j<N_ROTEADORES; j++)
+			if(custos_originais[a][j] != ORACULO_INF){
+				if(!strcmp(l->valor, "desliga")){
+					erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, a, j, INFINITO);
+					erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, j, a, INFINITO);
+				}else{
+					erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, a, j, custos_originais[a][j]);
+					erro |= acrescenta_evento(l->passo, EVENTO_ENLACE, j, a, custos_originais[j][a]);
+				}
+			}
+	}
+	
+	free(linhas_roteiro);
+	linhas_roteiro = NULL;
+	
+	if(erro) return -1;
+	
+	for(i=1; i<n_eventos; i++){
+		e = eventos[i];
+		for(j=i; j>0 && eventos[j-1].passo > e.passo; j--)
+			eventos[j] = eventos[j-1];
+		eventos[j] = e;
+	}
+	
+	printf("Roteiro %s: %d eventos, %d janelas.\n", arquivo_do_roteiro, n_eventos, n_janelas);
+	
+	return 0;
+}
+
+int eventos_pendentes(void){
+	
+	return proximo_evento < n_eventos;
+}
+
+/* Encerra a medida de reconvergência do grupo de eventos atual. */
+static void fecha_reconvergencia(void){
+	
+	int passos = ultima_variacao_roteiro - inicio_reconvergencia + 1;
+	
+	if(passos < 0) passos = 0;
+	printf("Reconvergência após o passo %d: %d passos.\n", inicio_reconvergencia, passos);
+	
+	if(passos > pior_reconvergencia)
+		pior_reconvergencia = passos;
+}
+
+int aplica_eventos(roteador * r, int passo, int pkt_drop){
+	
+	evento_t * e;
+	int enlaces = 0;
+	
+	for(; proximo_evento < n_eventos && eventos[proximo_evento].passo == passo; proximo_evento++){
+		
+		e = &eventos[proximo_evento];
+		
+		switch(e->tipo){
+			
+			case EVENTO_ENLACE:
+				if(!enlaces){
+					fecha_reconvergencia();
+					inicio_reconvergencia = passo;
+					ultima_variacao_roteiro = passo - 1;
+				}
+				altera_enlace(r, e->a, e->b, e->custo);
+				enlaces++;
+				break;
+			
+			case EVENTO_JANELA_INICIO:
+				janelas[e->a].pacotes    = -pacotes_enviados;
+				janelas[e->a].relaxacoes = -relaxacoes_roteiro;
+				janelas[e->a].descartes  = -pkt_drop;
+				break;
+			
+			case EVENTO_JANELA_FIM:
+				janelas[e->a].pacotes    += pacotes_enviados;
+				janelas[e->a].relaxacoes += relaxacoes_roteiro;
+				janelas[e->a].descartes  += pkt_drop;
+				janelas[e->a].fim = -janelas[e->a].fim - 1;	// marca a janela como encerrada
+				break;
+		}
+	}
+	
+	return enlaces;
+}
+
+void acompanha_roteiro(int passo, int delta){
+	
+	relaxacoes_roteiro += delta;
+	if(delta) ultima_variacao_roteiro = passo;
+}
+
+int avalia_roteiro(roteador * r, int passo, int pkt_drop){
+	
+	/* Janelas que terminariam depois do fim da simulação são encerradas
+	 * no último passo. */
+	
+	janela_t * j;
+	int i, falhas = 0, divergencias;
+	
+	fecha_reconvergencia();
+	
+	for(i=0; i<n_janelas; i++){
+		
+		j = &janelas[i];
+		if(j->fim >= 0){
+			if(j->inicio > passo) continue;
+			j->pacotes    += pacotes_enviados;
+			j->relaxacoes += relaxacoes_roteiro;
+			j->descartes  += pkt_drop;
+		}else
+			j->fim = -j->fim - 1;
+		
+		printf("Janela %d-%d: %ld pacotes, %ld mudanças, %ld descartes.\n", j->inicio, j->fim, j->pacotes, j->relaxacoes, j->descartes);
+	}
+	
+	if(afirma_converge >= 0){
+		printf("Afirmação \"converge %d\": %s (pior reconvergência: %d passos).\n", afirma_converge,
+			pior_reconvergencia <= afirma_converge ? "ok" : "FALHOU", pior_reconvergencia);
+		falhas += pior_reconvergencia > afirma_converge;
+	}
+	
+	if(afirma_confere){
+		divergencias = verifica_rotas(r);
+		printf("Afirmação \"confere\": %s.\n", divergencias ? "FALHOU" : "ok");
+		falhas += divergencias != 0;
+	}
+	
+	if(afirma_pacotes >= 0){
+		printf("Afirmação \"pacotes %ld\": %s (%ld enviados).\n", afirma_pacotes,
+			pacotes_enviados <= afirma_pacotes ? "ok" : "FALHOU", pacotes_enviados);
+		falhas += pacotes_enviados > afirma_pacotes;
+	}
+	
+	return falhas;
+}
+
+void enlaces_automaticos(roteador * r){
+	
+	int i, j;
+	
+	inicia_tabelas(r);
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES && conexoes_enlaces[i][j] != -1; j++){
+			_preencher_enlaces(r, i, conexoes_enlaces[i][j], DISTANCIA_AUTOMATICA);
+			custos_enlaces[i][conexoes_enlaces[i][j]] = DISTANCIA_AUTOMATICA;
+		}
+}
+
+void agenda_disparo(roteador * r, int r_idx){
+	
+	if(r[r_idx].disparo_pendente)
+		disparos_agrupados++;
+	r[r_idx].disparo_pendente = 1;
+}
+
+void relata_disparos(int pkt_drop){
+	
+	if(disparo_ativo)
+		printf("Atualizações disparadas (espera de %d a %d passos%s): %ld enviadas, %ld mudanças agrupadas.\n",
+			disparo_espera_min, disparo_espera_max, disparo_recuo ? ", recuo exponencial" : "",
+			disparos_enviados, disparos_agrupados);
+	printf("Pico de %ld mensagens por passo; %ld pacotes enviados, %d descartados.\n",
+		pico_mensagens, pacotes_enviados, pkt_drop);
+}
+
+/* Fator de decaimento da penalidade após d passos, para d menor que o
+ * tamanho da tabela (depois disso a penalidade é considerada zero). */
+#define AMORTECIMENTO_TABELA (16 * AMORTECIMENTO_MEIA_VIDA)
+static double fator_decaimento[AMORTECIMENTO_TABELA];
+
+void inicia_amortecimento(void){
+	
+	int d;
+	
+	for(d=0; d<AMORTECIMENTO_TABELA; d++)
+		fator_decaimento[d] = pow(0.5, (double) d / AMORTECIMENTO_MEIA_VIDA);
+}
+
+/* Atualiza a penalidade da rota até o passo atual. */
+static double penalidade_atual(int r_idx, int destino){
+	
+	int d = passo_atual - passo_penalidade[r_idx][destino];
+	
+	penalidade[r_idx][destino] *= d < AMORTECIMENTO_TABELA ? fator_decaimento[d] : 0;
+	passo_penalidade[r_idx][destino] = passo_atual;
+	
+	return penalidade[r_idx][destino];
+}
+
+int amortece(int r_idx, int destino, int custo, int caminho, int piora){
+	
+	/* Apenas pioras (inclusive a perda da rota) são penalizadas, como as
+	 * retiradas no RFC 2439; assim a convergência inicial, que só melhora
+	 * as rotas, não acumula penalidade. */
+	
+	double p;
+	
+	if(!piora) return 0;
+	
+	p = penalidade_atual(r_idx, destino) + AMORTECIMENTO_PENALIDADE;
+	if(p > AMORTECIMENTO_TETO) p = AMORTECIMENTO_TETO;
+	penalidade[r_idx][destino] = p;
+	
+	if(p > AMORTECIMENTO_SUPRESSAO){
+		rota_suprimida[r_idx][destino] = 1;
+		suprimidas_roteador[r_idx]++;
+		supressoes[r_idx]++;
+		anuncios_ignorados[r_idx]++;
+		anuncio_suprimido[r_idx][destino].custo   = custo;
+		anuncio_suprimido[r_idx][destino].caminho = caminho;
+		return 1;
+	}
+	
+	return 0;
+}
+
+/* Libera a rota suprimida, aplicando a rota guardada. Retorna 1 se a
+ * tabela mudou. */
+static int libera_rota(roteador * r, int r_idx, int destino){
+	
+	rota_t * guardada = &anuncio_suprimido[r_idx][destino];
+	
+	rota_suprimida[r_idx][destino] = 0;
+	suprimidas_roteador[r_idx]--;
+	
+	if(r[r_idx].rotas[destino].custo == guardada->custo && r[r_idx].rotas[destino].caminho == guardada->caminho)
+		return 0;
+	
+	r[r_idx].rotas[destino].custo   = guardada->custo;
+	r[r_idx].rotas[destino].caminho = guardada->caminho;
+	ultima_mudanca[r_idx][destino] = passo_atual;
+	
+	return 1;
+}
+
+int segue_suprimida(roteador * r, int r_idx, int destino, int remetente, int custo, int * delta){
+	
+	/* A rota guardada segue a mesma regra de recebe_pacote(), para que a
+	 * liberação produza o que a tabela teria sem a supressão. */
+	
+	rota_t * guardada = &anuncio_suprimido[r_idx][destino];
+	
+	if(penalidade_atual(r_idx, destino) < AMORTECIMENTO_REUSO){
+		*delta += libera_rota(r, r_idx, destino);
+		return 0;
+	}
+	
+	if( guardada->custo > custo || (guardada->caminho == remetente && guardada->custo != custo) ){
+		guardada->custo   = custo;
+		guardada->caminho = custo == INFINITO ? -1 : remetente;
+		anuncios_ignorados[r_idx]++;
+	}
+	
+	return 1;
+}
+
+int libera_suprimidas(roteador * r, int * restantes){
+	
+	/* Chamada apenas quando a rede parece estável: uma rota suprimida cujos
+	 * anúncios não mudam nunca seria consultada por segue_suprimida().
+	 * Percorre só os roteadores que têm rotas suprimidas. */
+	
+	int r_idx, destino, liberadas = 0, mudou;
+	
+	*restantes = 0;
+	if(!amortecimento_ativo) return 0;
+	
+	for(r_idx=0; r_idx<N_ROTEADORES; r_idx++){
+		
+		if(!suprimidas_roteador[r_idx]) continue;
+		
+		mudou = 0;
+		for(destino=0; destino<N_ROTEADORES; destino++)
+			if(rota_suprimida[r_idx][destino] && penalidade_atual(r_idx, destino) < AMORTECIMENTO_REUSO){
+				mudou += libera_rota(r, r_idx, destino);
+				liberadas++;
+			}
+		
+		/* A rota liberada precisa ser anunciada como qualquer mudança. */
+		if(mudou){
+			roteador_alterado[r_idx] = 1;
+			if(disparo_ativo)
+				agenda_disparo(r, r_idx);
+		}
+		
+		*restantes += suprimidas_roteador[r_idx];
+	}
+	
+	return liberadas;
+}
+
+void relata_amortecimento(void){
+	
+	long total_supressoes = 0, total_ignorados = 0;
+	int r_idx;
+	
+	for(r_idx=0; r_idx<N_ROTEADORES; r_idx++){
+		total_supressoes += supressoes[r_idx];
+		total_ignorados  += anuncios_ignorados[r_idx];
+	}
+	
+	printf("Amortecimento: %ld supressões de rotas, %ld mudanças ignoradas.\n", total_supressoes, total_ignorados);
+}
+
+long planeja_memoria(void){
+	
+	/* Soma o que o simulador reserva e de fato usa nesta execução: as
+	 * estruturas de tamanho fixo, os eventos do roteiro compilado, os vetores
+	 * do io_uring (só com -u) e o estado do amortecimento. O índice de
+	 * quadros-chave do traço cresce com a execução e é mostrado por passo.
+	 * Não inclui o próprio programa e as bibliotecas, que já estão na
+	 * memória residente medida no início e são descontados em relata_memoria().
+	 * 
+	 * O tráfego por passo considera que, em média, um roteador envia a cada
+	 * intervalo_periodo+1 passos, escrevendo um pacote no buffer de cada
+	 * vizinho, e que cada pacote é lido uma vez no recebimento e pode
+	 * reescrever a tabela do destinatário. */
+	
+	static const char * nomes_layout[] = {"layout atual", "custo e caminho de 16 bits", "custo e caminho de 8 bits"};
+	
+	long tabelas      = (long) N_ROTEADORES * sizeof(((roteador *) 0)->rotas);
+	long entradas     = (long) N_ROTEADORES * sizeof(((roteador *) 0)->entrada);
+	long controle     = (long) N_ROTEADORES * sizeof(roteador) - tabelas - entradas;
+	long adjacencia   = sizeof(conexoes_enlaces) + sizeof(custos_enlaces) + sizeof(pacotes_enlace);
+	long oraculo      = sizeof(distancias_referencia);
+	long auxiliares   = sizeof(ultima_mudanca) + sizeof(destinos_amostrados) + sizeof(roteador_alterado) + sizeof(alterado_no_recebimento);
+	long roteiro      = (long) n_eventos * sizeof(evento_t) + (long) n_janelas * sizeof(janela_t);
+	long udp          = (anel.fd < 0 ? 0 : sizeof(anel_mensagens) + sizeof(anel_iovs) + sizeof(anel_cabecalhos) + sizeof(anel_enderecos)) +
+	                    (recepcao.fd < 0 ? 0 : recepcao_tamanho_anel + (long) recepcao_n_buffers * recepcao_tamanho_buffer);
+	long amortecimento = sizeof(penalidade) + sizeof(passo_penalidade) + sizeof(rota_suprimida) + sizeof(anuncio_suprimido) +
+	                     sizeof(suprimidas_roteador) + sizeof(supressoes) + sizeof(anuncios_ignorados);
+	long total        = tabelas + entradas + controle + adjacencia + oraculo + auxiliares + roteiro + udp + amortecimento;
+	
+	long enlaces = 0;
+	double envios_por_passo, trafego;
+	long bytes_rota[3], necessario, demais, disponivel, cache;
+	int representavel[3], escolhido, k, i, j;
+	
+	for(i=0; i<N_ROTEADORES; i++)
+		for(j=0; j<N_ROTEADORES; j++)
+			if(conexoes_enlaces[i][j] != -1)
+				enlaces++;
+	
+	envios_por_passo = (double) enlaces / (intervalo_periodo + 1);
+	trafego = envios_por_passo * 2 * sizeof(pacote_t) + envios_por_passo * n_destinos * sizeof(rota_t);
+	
+	printf("Estimativa de memória (%d roteadores, %ld enlaces, buffer de %d pacotes):\n", N_ROTEADORES, enlaces, PKT_BUFFER);
+	printf("  tabelas de roteamento   %10ld bytes\n", tabelas);
+	printf("  buffers de entrada      %10ld bytes\n", entradas);
+	printf("  controle dos roteadores %10ld bytes\n", controle);
+	printf("  adjacência e custos     %10ld bytes\n", adjacencia);
+	printf("  oráculo                 %10ld bytes\n", oraculo);
+	printf("  auxiliares              %10ld bytes\n", auxiliares);
+	printf("  eventos do roteiro      %10ld bytes\n", roteiro);
+	printf("  io_uring                %10ld bytes\n", udp);
+	printf("  amortecimento           %10ld bytes\n", amortecimento);
+	printf("  total                   %10ld bytes\n", total);
+	printf("  (o traço, com -G, soma %ld bytes de índice a cada %d passos)\n", (long) 2 * sizeof(int64_t), INTERVALO_QUADROS);
+	printf("Tráfego estimado por passo: %.0f bytes (%.1f pacotes).\n", trafego, envios_por_passo);
+	
+	/* Layouts possíveis para cada rota, do atual ao menor. O destino é
+	 * implícito na posição da rota, então só custo e caminho são
+	 * necessários; a largura deles depende de INFINITO e N_ROTEADORES.
+	 * 
+	 * O escolhido é o mais largo (o que menos muda o código) entre os que
+	 * cabem na memória livre e cujas tabelas e buffers cabem no último
+	 * nível de cache; se nenhum cabe no cache, o mais largo que cabe na
+	 * memória. Se nenhum cabe na memória, o menor. */
+	bytes_rota[0] = sizeof(rota_t);
+	bytes_rota[1] = 2 * sizeof(uint16_t);
+	bytes_rota[2] = 2 * sizeof(uint8_t);
+	representavel[0] = 1;
+	representavel[1] = INFINITO < 65536 && N_ROTEADORES < 65536;
+	representavel[2] = INFINITO < 256 && N_ROTEADORES < 256;
+	
+	necessario = (long) N_ROTEADORES * N_ROTEADORES * (1 + PKT_BUFFER);
+	demais     = total - tabelas - entradas;
+	disponivel = sysconf(_SC_AVPHYS_PAGES) * (long) getpagesize();
+	cache      = sysconf(_SC_LEVEL3_CACHE_SIZE);
+	if(cache <= 0) cache = sysconf(_SC_LEVEL2_CACHE_SIZE);
+	
+	printf("Bytes por rota: atual %ld, 16 bits %ld, 8 bits %ld; %ld bytes livres, cache de %ld bytes.\n",
+		bytes_rota[0], bytes_rota[1], bytes_rota[2], disponivel, cache > 0 ? cache : 0);
+	
+	escolhido = -1;
+	for(k=0; k<3 && escolhido < 0; k++)
+		if(representavel[k] && necessario * bytes_rota[k] + demais <= disponivel && necessario * bytes_rota[k] <= cache)
+			escolhido = k;
+	for(k=0; k<3 && escolhido < 0; k++)
+		if(representavel[k] && necessario * bytes_rota[k] + demais <= disponivel)
+			escolhido = k;
+	
+	if(escolhido < 0){
+		for(k=2; !representavel[k]; k--);
+		printf("Recomendado: %s; nenhum layout cabe nos %ld bytes livres (%s: %ld bytes).\n\n",
+			nomes_layout[k], disponivel, nomes_layout[k], necessario * bytes_rota[k] + demais);
+	}else
+		printf("Recomendado: %s (%ld bytes de tabelas e buffers, %s no cache).\n\n",
+			nomes_layout[escolhido], necessario * bytes_rota[escolhido],
+			necessario * bytes_rota[escolhido] <= cache ? "cabem" : "não cabem");
+	
+	return total;
 }